@@ -0,0 +1,279 @@
+#ifndef LIB_BATCH_RECOMMENDER_H
+#define LIB_BATCH_RECOMMENDER_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "./data_structures/cust_vector.hpp"
+#include "./kernels/distance_kernels.hpp"
+#include "./parallel/thread_pool.h"
+#include "crypto_rec.hpp"
+
+/*
+ * Batch Recommender
+ *
+ * Calculates the recommendations of a whole population of users at once, instead of one user at a time
+ *
+ * Users are gathered into groups that share the same candidate neighbors, either explicitly (eg. the users of a
+ * cluster) or by their candidates (eg. users with the same LSH candidates, which is the case for all users with the
+ * same buckets in every hashtable)
+ * The candidates of a group are normalized and stacked into one matrix, so the cosine similarities of a block of its
+ * users with all of them are a single matrix multiplication, done by the projection kernel
+ * Every user then keeps its P most similar candidates and gets its top N predicted cryptocurrencies, from the mean
+ * centered scores of the candidates, which are also calculated once per group
+ * Blocks of users are independent, so they are scored in parallel and their recommendations are kept by user index
+ *
+ * Every group keeps its own copy of its candidates, so callers with many different candidate lists (eg. LSH queries
+ * with multi-probe or a cap) recommend in batches, scoring and clearing the groups once they hold
+ * RECOMMENDATION_BATCH_CANDIDATES candidates, which bounds the memory of the groups
+ *
+ * Templated, so that it can recommend from any type of vector (int, float type dimensions)
+ */
+
+
+// Users of a group whose similarities are calculated together, bounds the similarity buffer of a group
+const unsigned int RECOMMENDATION_BLOCK_ROWS = 64;
+// Candidates of all groups after which a batch of users should be recommended and the groups cleared
+const unsigned long RECOMMENDATION_BATCH_CANDIDATES = 1 << 20;
+
+
+template <typename dim_type>
+class BatchRecommender {
+private:
+    // Group of each user, -1 for users without candidates
+    std::vector<int> user_groups;
+    std::vector< std::vector<int> > group_users;
+    std::vector< std::vector< CustVector<dim_type>* > > group_candidates;
+
+    // Groups added by their candidates, by the hash of the candidates
+    std::unordered_map< uint64_t, std::vector<int> > candidate_groups;
+    // Candidates of all groups together
+    unsigned long candidate_num;
+
+    uint64_t hashCandidates(const std::vector< CustVector<dim_type>* >& candidates) const;
+
+    // Normalized and transposed candidates of a group, for the projection kernel, and their centered scores
+    void prepareGroup(int group_i, std::vector<double>* candidates_t, std::vector<double>* centered_scores) const;
+
+    // Recommendations of one block of the users of a group, starting from the block_begin-th one
+    void recommendBlock(std::vector< CustVector<dim_type> >& users, int group_i, unsigned int block_begin, int P, int N,
+                        const std::vector<double>& candidates_t, const std::vector<double>& centered_scores,
+                        std::vector< std::vector<int> >* recommendations) const;
+
+public:
+    BatchRecommender(unsigned int user_num);
+
+    // Add a group with the given candidates and return its index, users are then added to it with addUserToGroup
+    int addGroup(const std::vector< CustVector<dim_type>* >& candidates);
+    void addUserToGroup(int user_i, int group_i);
+
+    // Add a user with its candidates, to the group with the exact same candidates in the same order if there is one
+    void addUser(int user_i, const std::vector< CustVector<dim_type>* >& candidates);
+
+    // Top N recommendations of every user that has been added, as indexes of cryptocurrencies, each one from the P
+    // most similar candidates of the user (all of them, in their order, if P is not positive)
+    // Users are the ones whose indexes were added, recommendations are written at the same indexes
+    // Blocks of users are split among the threads of the pool, the result does not depend on the number of threads
+    void recommend(std::vector< CustVector<dim_type> >& users, int P, int N,
+                   std::vector< std::vector<int> >* recommendations, ThreadPool& pool);
+
+    // Remove every group and its users, so the next batch of users can be added
+    void clear();
+
+    bool hasCandidates(int user_i) const;
+    unsigned int getGroupNumber() const;
+    unsigned long getCandidateNumber() const;
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+BatchRecommender<dim_type>::BatchRecommender(unsigned int user_num) : user_groups(user_num, -1), candidate_num(0) {}
+
+
+template <typename dim_type>
+int BatchRecommender<dim_type>::addGroup(const std::vector< CustVector<dim_type>* >& candidates) {
+    group_users.emplace_back();
+    group_candidates.emplace_back(candidates);
+    candidate_num = candidate_num + candidates.size();
+
+    return group_candidates.size() - 1;
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::addUserToGroup(int user_i, int group_i) {
+    user_groups[user_i] = group_i;
+    group_users[group_i].emplace_back(user_i);
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::addUser(int user_i, const std::vector< CustVector<dim_type>* >& candidates) {
+    std::vector<int>& same_hash_groups = candidate_groups[hashCandidates(candidates)];
+    for (int group_i : same_hash_groups) {
+        if (group_candidates[group_i] == candidates) {
+            addUserToGroup(user_i, group_i);
+            return;
+        }
+    }
+
+    int group_i = addGroup(candidates);
+    same_hash_groups.emplace_back(group_i);
+    addUserToGroup(user_i, group_i);
+}
+
+
+template <typename dim_type>
+uint64_t BatchRecommender<dim_type>::hashCandidates(const std::vector< CustVector<dim_type>* >& candidates) const {
+    // FNV-1a over the candidate pointers, in order
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto candidate : candidates) {
+        hash = hash ^ (uint64_t) (uintptr_t) candidate;
+        hash = hash * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::recommend(std::vector< CustVector<dim_type> >& users, int P, int N,
+                                           std::vector< std::vector<int> >* recommendations, ThreadPool& pool) {
+    recommendations->assign(users.size(), std::vector<int>());
+
+    // Groups with more than one block are prepared first and shared by the tasks of their blocks, each one of the
+    // other groups is a single task that prepares it by itself
+    std::vector<int> shared_groups;
+    std::vector<int> block_groups;
+    std::vector<unsigned int> block_begins;
+    for (int group_i = 0; group_i < group_users.size(); group_i++) {
+        if (group_users[group_i].empty() || group_candidates[group_i].empty())
+            continue;
+        if (group_users[group_i].size() > RECOMMENDATION_BLOCK_ROWS)
+            shared_groups.push_back(group_i);
+        for (unsigned int begin = 0; begin < group_users[group_i].size(); begin += RECOMMENDATION_BLOCK_ROWS) {
+            block_groups.push_back(group_i);
+            block_begins.push_back(begin);
+        }
+    }
+
+    std::vector< std::vector<double> > group_candidates_t(group_users.size());
+    std::vector< std::vector<double> > group_centered_scores(group_users.size());
+    pool.parallelFor(shared_groups.size(), [&](unsigned int shared_i) {
+        int group_i = shared_groups[shared_i];
+        prepareGroup(group_i, &group_candidates_t[group_i], &group_centered_scores[group_i]);
+    });
+
+    // Each task writes the recommendations of the users of its own block only, so they are the same for any number
+    // of threads and are printed afterwards in the order of the users
+    pool.parallelFor(block_begins.size(), [&](unsigned int block_i) {
+        int group_i = block_groups[block_i];
+        if (group_users[group_i].size() > RECOMMENDATION_BLOCK_ROWS) {
+            recommendBlock(users, group_i, block_begins[block_i], P, N, group_candidates_t[group_i],
+                           group_centered_scores[group_i], recommendations);
+        }
+        else {
+            std::vector<double> candidates_t;
+            std::vector<double> centered_scores;
+            prepareGroup(group_i, &candidates_t, &centered_scores);
+            recommendBlock(users, group_i, block_begins[block_i], P, N, candidates_t, centered_scores,
+                           recommendations);
+        }
+    });
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::prepareGroup(int group_i, std::vector<double>* candidates_t,
+                                              std::vector<double>* centered_scores) const {
+    const std::vector< CustVector<dim_type>* >& candidates = group_candidates[group_i];
+
+    // Normalized candidates, transposed (dim_num x candidate_num)
+    unsigned int candidate_num = candidates.size();
+    unsigned int dim_num = candidates[0]->getDimensions()->size();
+    candidates_t->resize(dim_num * candidate_num);
+    for (unsigned int cand_i = 0; cand_i < candidate_num; cand_i++) {
+        std::vector<dim_type>& cand_dims = *(candidates[cand_i]->getDimensions());
+        double norm = candidates[cand_i]->getNorm();
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+            (*candidates_t)[dim_i * candidate_num + cand_i] = cand_dims[dim_i] / norm;
+    }
+
+    // Scores of the candidates minus their means, shared by the predictions of every user of the group
+    *centered_scores = get_centered_scores(candidates);
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::recommendBlock(std::vector< CustVector<dim_type> >& users, int group_i,
+                                                unsigned int block_begin, int P, int N,
+                                                const std::vector<double>& candidates_t,
+                                                const std::vector<double>& centered_scores,
+                                                std::vector< std::vector<int> >* recommendations) const {
+    const std::vector<int>& block_users = group_users[group_i];
+    unsigned int candidate_num = group_candidates[group_i].size();
+    unsigned int dim_num = candidates_t.size() / candidate_num;
+    unsigned int row_num = std::min<unsigned int>(RECOMMENDATION_BLOCK_ROWS, block_users.size() - block_begin);
+
+    std::vector<const dim_type*> rows(row_num);
+    for (unsigned int row_i = 0; row_i < row_num; row_i++)
+        rows[row_i] = users[block_users[block_begin + row_i]].getDimensions()->data();
+    std::vector<double> inner_products(row_num * candidate_num);
+    projection_kernel(rows.data(), row_num, dim_num, candidates_t.data(), candidate_num, inner_products.data());
+
+    std::vector<int> all_neighbors(candidate_num);
+    for (unsigned int cand_i = 0; cand_i < candidate_num; cand_i++)
+        all_neighbors[cand_i] = cand_i;
+
+    for (unsigned int row_i = 0; row_i < row_num; row_i++) {
+        int user_i = block_users[block_begin + row_i];
+        CustVector<dim_type>& user = users[user_i];
+
+        // Dividing by the norm of the user turns the inner products with the normalized candidates into cosines
+        double user_norm = user.getNorm();
+        std::vector<double> similarities(inner_products.begin() + row_i * candidate_num,
+                                         inner_products.begin() + (row_i + 1) * candidate_num);
+        for (auto& similarity : similarities)
+            similarity = similarity / user_norm;
+
+        // Neighbors as rows of the centered scores
+        std::vector<int> neighbors = all_neighbors;
+        if (P > 0)
+            select_top(similarities, neighbors, P);
+
+        (*recommendations)[user_i] = get_top_N_recom(centered_scores, neighbors, user, N, similarities);
+    }
+}
+
+
+template <typename dim_type>
+void BatchRecommender<dim_type>::clear() {
+    for (auto& users : group_users)
+        for (int user_i : users)
+            user_groups[user_i] = -1;
+    group_users.clear();
+    group_candidates.clear();
+    candidate_groups.clear();
+    candidate_num = 0;
+}
+
+
+template <typename dim_type>
+bool BatchRecommender<dim_type>::hasCandidates(int user_i) const { return user_groups[user_i] >= 0; }
+
+
+template <typename dim_type>
+unsigned int BatchRecommender<dim_type>::getGroupNumber() const { return group_candidates.size(); }
+
+
+template <typename dim_type>
+unsigned long BatchRecommender<dim_type>::getCandidateNumber() const { return candidate_num; }
+
+
+#endif //LIB_BATCH_RECOMMENDER_H
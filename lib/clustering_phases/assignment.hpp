@@ -8,6 +8,9 @@
 
 #include "../data_structures/cust_vector.hpp"
 #include "../data_structures/cust_hashtable.hpp"
+#include "../data_structures/distance_cache.h"
+#include "../data_structures/candidate_set.h"
+#include "../parallel/thread_pool.h"
 
 #include "../lsh_cube.hpp"
 #include "../utils.hpp"
@@ -21,6 +24,15 @@
  */
 
 
+// Number of chunks that parallel Lloyd's splits the input vectors into, independent of the number of threads so
+// that the partial sums, and with them the whole clustering, do not depend on how many threads are used
+const unsigned int LLOYDS_CHUNK_NUM = 64;
+
+// Find the centroid that is closest to a vector, depending on the metric used, and its distance from it
+template <typename vector_type>
+int nearest_centroid(CustVector<vector_type>& in_vector, std::vector< CustVector<vector_type>* >& centroids,
+        const std::string& metric_type, double* min_distance);
+
 // Lloyd's assignment algorithm, for each input vector to be assigned, assign it to the cluster whose centroid is
 // closest to it, depending on the metric used
 template <typename vector_type>
@@ -32,44 +44,64 @@ template <typename vector_type>
 void lloyds_for_remaining(std::vector< CustVector<vector_type> >& input_vectors, std::vector< CustVector<vector_type>* >& centroids,
                       std::string metric_type);
 
+// Parallel version of lloyds_for_remaining, vectors are split in chunks that are assigned by the threads of the pool
+template <typename vector_type>
+void parallel_lloyds_for_remaining(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, ThreadPool& pool);
 
+
+// Range search assignments, the vectors that no range search reaches are then assigned by parallel Lloyd's with the
+// threads of the pool
 template <typename vector_type>
 void lsh_range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
         std::vector< CustHashtable<vector_type>* >& lsh_hashtables, std::vector< CustVector<vector_type>* >& centroids,
-        std::string metric_type);
+        std::string metric_type, ThreadPool& pool);
 
 template <typename vector_type>
 void cube_range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
         CustHashtable<vector_type>& hypercube, std::vector< CustVector<vector_type>* >& centroids,
-        std::string metric_type, int probes, int k);
+        std::string metric_type, int probes, int k, ThreadPool& pool);
 
+// Range search assignment of the vectors in the combined buckets of each centroid, the buckets must point to vectors of
+// input_vectors
 template <typename vector_type>
-void range_assignment(std::vector< std::vector< CustVector<vector_type>* > >& comb_buckets, std::vector< CustVector<vector_type>* >& centroids,
-                      std::string metric_type);
+void range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< std::vector< CustVector<vector_type>* > >& comb_buckets, std::vector< CustVector<vector_type>* >& centroids,
+        std::string metric_type);
 
 /*
 * Function definitions
 */
 
+template <typename vector_type>
+int nearest_centroid(CustVector<vector_type>& in_vector, std::vector< CustVector<vector_type>* >& centroids,
+        const std::string& metric_type, double* min_distance) {
+    double min = -1;
+    int min_centroid_i = 0;
+    for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++) {
+        double distance = 0;
+        if (metric_type == "euclidean")
+            distance = in_vector.euclideanDistance(centroids[centroid_i]);
+        else if (metric_type == "cosine")
+            distance = in_vector.cosineDistance(centroids[centroid_i]);
+
+        if (min == -1 || distance < min) {
+            min = distance;
+            min_centroid_i = centroid_i;
+        }
+    }
+
+    *min_distance = min;
+    return min_centroid_i;
+}
+
+
 template <typename vector_type>
 void lloyds_assignment(std::vector< CustVector<vector_type> >& input_vectors, std::vector< CustVector<vector_type>* >& centroids,
         std::string metric_type) {
     for (int vector_i = 0; vector_i < input_vectors.size(); vector_i++) {
-        double min = -1;
-        int min_centroid_i = 0;
-        for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++) {
-            double distance = 0;
-            if (metric_type == "euclidean")
-                distance = input_vectors[vector_i].euclideanDistance(centroids[centroid_i]);
-            else if (metric_type == "cosine")
-                distance = input_vectors[vector_i].cosineDistance(centroids[centroid_i]);
-
-            if (min == -1 || distance < min) {
-                min = distance;
-                min_centroid_i = centroid_i;
-            }
-        }
-
+        double min = 0;
+        int min_centroid_i = nearest_centroid(input_vectors[vector_i], centroids, metric_type, &min);
         input_vectors[vector_i].setCluster(min_centroid_i, min);
     }
 
@@ -85,43 +117,55 @@ void lloyds_for_remaining(std::vector< CustVector<vector_type> >& input_vectors,
                        std::string metric_type) {
     for (int vector_i = 0; vector_i < input_vectors.size(); vector_i++) {
         if (input_vectors[vector_i].getCluster() == -1) {
-            double min = -1;
-            int min_centroid_i = 0;
-            for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++) {
-                double distance = 0;
-                if (metric_type == "euclidean")
-                    distance = input_vectors[vector_i].euclideanDistance(centroids[centroid_i]);
-                else if (metric_type == "cosine")
-                    distance = input_vectors[vector_i].cosineDistance(centroids[centroid_i]);
-
-                if (min == -1 || distance < min) {
-                    min = distance;
-                    min_centroid_i = centroid_i;
-                }
-            }
+            double min = 0;
+            int min_centroid_i = nearest_centroid(input_vectors[vector_i], centroids, metric_type, &min);
             input_vectors[vector_i].setCluster(min_centroid_i, min);
         }
     }
 }
 
 
+template <typename vector_type>
+void parallel_lloyds_for_remaining(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, ThreadPool& pool) {
+    unsigned int chunk_num = LLOYDS_CHUNK_NUM;
+    if (input_vectors.size() < chunk_num)
+        chunk_num = input_vectors.size();
+
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        unsigned int begin, end;
+        get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
+
+        for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+            if (input_vectors[vector_i].getCluster() == -1) {
+                double min = 0;
+                int min_centroid_i = nearest_centroid(input_vectors[vector_i], centroids, metric_type, &min);
+                input_vectors[vector_i].setCluster(min_centroid_i, min);
+            }
+        }
+    });
+}
+
+
 template <typename vector_type>
 void lsh_range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
         std::vector< CustHashtable<vector_type>* >& lsh_hashtables, std::vector< CustVector<vector_type>* >& centroids,
-        std::string metric_type) {
+        std::string metric_type, ThreadPool& pool) {
 
     // For this algorithm, no vectors should be assigned to any cluster initially
     remove_clustering(input_vectors);
 
     // Get buckets from lsh hashtables
     std::vector< std::vector< CustVector<vector_type>* > > comb_buckets(centroids.size());
+    CandidateSet candidates(input_vectors.size());
     for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
-        comb_buckets[centroid_i] = get_LSH_combined_buckets<vector_type>(lsh_hashtables, centroids[centroid_i]);
+        comb_buckets[centroid_i] = get_LSH_combined_buckets<vector_type>(lsh_hashtables, centroids[centroid_i],
+                                                                         candidates);
 
-    range_assignment(comb_buckets, centroids, metric_type);
+    range_assignment(input_vectors, comb_buckets, centroids, metric_type);
 
     // Then, for use the standard lloyd's algorithm to assign any unassigned vectors to a centroid
-    lloyds_for_remaining(input_vectors, centroids, metric_type);
+    parallel_lloyds_for_remaining(input_vectors, centroids, metric_type, pool);
 
     // Each centroid is assigned to its cluster
     for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
@@ -131,7 +175,7 @@ void lsh_range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
 template <typename vector_type>
 void cube_range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
                           CustHashtable<vector_type>& hypercube, std::vector< CustVector<vector_type>* >& centroids,
-                          std::string metric_type, int probes, int k) {
+                          std::string metric_type, int probes, int k, ThreadPool& pool) {
 
     // For this algorithm, no vectors should be assigned to any cluster initially
     remove_clustering(input_vectors);
@@ -141,10 +185,10 @@ void cube_range_assignment(std::vector< CustVector<vector_type> >& input_vectors
     for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
         comb_buckets[centroid_i] = get_hypercube_combined_buckets<vector_type>(hypercube, centroids[centroid_i], probes, k);
 
-    range_assignment(comb_buckets, centroids, metric_type);
+    range_assignment(input_vectors, comb_buckets, centroids, metric_type);
 
     // Then, for use the standard lloyd's algorithm to assign any unassigned vectors to a centroid
-    lloyds_for_remaining(input_vectors, centroids, metric_type);
+    parallel_lloyds_for_remaining(input_vectors, centroids, metric_type, pool);
 
     // Each centroid is assigned to its cluster
     for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
@@ -153,20 +197,25 @@ void cube_range_assignment(std::vector< CustVector<vector_type> >& input_vectors
 
 
 template <typename vector_type>
-void range_assignment(std::vector< std::vector< CustVector<vector_type>* > >& comb_buckets, std::vector< CustVector<vector_type>* >& centroids,
+void range_assignment(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< std::vector< CustVector<vector_type>* > >& comb_buckets, std::vector< CustVector<vector_type>* >& centroids,
         std::string metric_type) {
 
     // First find the minimum distance between two centroids and make it divided by 2 the initial range for each range search
     // After each iteration the range will be doubled, until no new vectors are assigned
     double radius = find_min_vector_distance(centroids, metric_type) / 2;
     double min_radius = 0;
-    // Use map to store calculated distances for this centroid as all distances are calculated for the first iteration anyway
-    std::unordered_map<std::string, double> distanceMap;
+    // Cache calculated distances, as all distances are calculated for the first iteration anyway
+    // Input vectors are indexed by their position and centroids come after them, the triangular matrix is only used
+    // if it is not much larger than the number of distances that will be cached
+    unsigned long bucket_vector_num = 0;
+    for (auto& comb_bucket : comb_buckets)
+        bucket_vector_num = bucket_vector_num + comb_bucket.size();
+    DistanceCache distanceCache(input_vectors.size() + centroids.size(), 4 * bucket_vector_num * sizeof(double));
 
     // For each centroid, search for R-Near neighbors with initial radius equal to input, then doubling it with
     // each iteration, until no new neighbors are found
     int assigned_count;
-    int map_count = 0;
     do {
         assigned_count = 0;
         for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++) {
@@ -180,17 +229,15 @@ void range_assignment(std::vector< std::vector< CustVector<vector_type>* > >& co
                 if ( (bucketVector->getCluster() == -1) ||
                      (bucketVector->getCluster() != -1 && bucketVector->getDistFromCentroid() >= min_radius) ) {
 
-                    std::string key = centroids[centroid_i]->getId() + "to" + bucketVector->getId();
+                    unsigned int vector_index = bucketVector - &input_vectors[0];
+                    unsigned int centroid_index = input_vectors.size() + centroid_i;
                     double distance = 0;
-                    if (distanceMap.count(key) == 1) {
-                        distance = distanceMap[key];
-                        map_count++;
-                    } else {
+                    if (!distanceCache.get(centroid_index, vector_index, &distance)) {
                         if (metric_type == "euclidean")
                             distance = centroids[centroid_i]->euclideanDistance(bucketVector);
                         else if (metric_type == "cosine")
                             distance = centroids[centroid_i]->cosineDistance(bucketVector);
-                        distanceMap[key] = distance;
+                        distanceCache.set(centroid_index, vector_index, distance);
                     }
                     // If vector is inside radius assign
                     if (distance >= min_radius && distance < radius) {
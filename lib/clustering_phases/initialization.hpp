@@ -5,31 +5,52 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 
-#include <chrono>
 #include <random>
 
 #include "../data_structures/cust_vector.hpp"
+#include "../parallel/thread_pool.h"
+
+#include "assignment.hpp"
 
 
 /*
  * Functions used to implement various initialization algorithms required for vector clustering
- * Namely, random selection and k-means++
+ * Namely, random selection, k-means++ and k-means||
  *
  * All functions are templated, so they can be used for any kind of input vector type
  */
 
 
 // Function that selects random k unique vectors uniformly from input to serve as initial centroids
+// Like every initialization algorithm here, the random choices only depend on the seed
 template <typename vector_type>
-std::vector< CustVector<vector_type>* > rand_selection(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num);
+std::vector< CustVector<vector_type>* > rand_selection(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num,
+                                                       unsigned long seed);
 
 // Function uses the k-means++ algorithm to select initial centroids
 // Basically, in each iteration, pick a new centroid randomly among input vectors, but with probability proportional to
 // the distance of that vector to its closest centroid (that have been previously selected)
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > k_means_pp(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num,
-                                                   std::string metric_type);
+                                                   std::string metric_type, unsigned long seed);
+
+// Scalable k-means++ (k-means||), instead of picking one centroid at a time, in each of a few rounds every vector
+// becomes a candidate independently, with probability oversampling times its squared distance from the closest
+// candidate over the sum of them, with vectors split in chunks that are handled in parallel by the pool
+// The candidates, weighted by the number of vectors closest to each one, are then reduced to cluster_num centroids
+// with k-means++
+template <typename vector_type>
+std::vector< CustVector<vector_type>* > k_means_parallel(std::vector< CustVector<vector_type> >& input_vectors,
+        int cluster_num, std::string metric_type, int rounds, double oversampling, unsigned long seed, ThreadPool& pool);
+
+// Distance between two vectors depending on the metric used
+template <typename vector_type>
+double vector_distance(CustVector<vector_type>& in_vector, CustVector<vector_type>* other, const std::string& metric_type);
+
+// Random index, with probability proportional to its weight
+inline int weighted_random_index(std::vector<double>& weights, std::default_random_engine& rand_generator);
 
 
 /*
@@ -37,11 +58,10 @@ std::vector< CustVector<vector_type>* > k_means_pp(std::vector< CustVector<vecto
 */
 
 template <typename vector_type>
-std::vector< CustVector<vector_type>* > rand_selection(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num) {
+std::vector< CustVector<vector_type>* > rand_selection(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num,
+                                                       unsigned long seed) {
     // Uniform integer random stuff and rand_generator initialization
-    unsigned long seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rand_generator;
-    rand_generator.seed(seed);
+    std::default_random_engine rand_generator(seed);
     std::uniform_int_distribution<int> uni_int_dist(0, input_vectors.size()-1);
     int rand_i = uni_int_dist(rand_generator);
 
@@ -70,11 +90,9 @@ std::vector< CustVector<vector_type>* > rand_selection(std::vector< CustVector<v
 
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > k_means_pp(std::vector< CustVector<vector_type> >& input_vectors, int cluster_num,
-        std::string metric_type) {
+        std::string metric_type, unsigned long seed) {
     // Uniform integer random stuff and rand_generator initialization
-    unsigned long seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rand_generator;
-    rand_generator.seed(seed);
+    std::default_random_engine rand_generator(seed);
     std::uniform_int_distribution<int> uni_int_dist(0, input_vectors.size()-1);
     int rand_i = uni_int_dist(rand_generator);
 
@@ -83,77 +101,168 @@ std::vector< CustVector<vector_type>* > k_means_pp(std::vector< CustVector<vecto
     std::vector<CustVector<vector_type>* > centroids(cluster_num);
     centroids[0] = &input_vectors[rand_i];
 
-    // Cache distances that have already been calculated
-    std::unordered_map<std::string, double> distanceMap;
-
-    std::vector<double> min_dists(input_vectors.size());
+    // Distance of each vector from its closest centroid so far, only the newest centroid can lower it, so each
+    // iteration calculates a single distance per vector
+    std::vector<double> min_dists(input_vectors.size(), -1);
+    std::vector<double> weights(input_vectors.size());
     for (int i = 1; i < cluster_num; i++) {
-        double max_for_normalizing = 0;
-
         for (int vector_i = 0; vector_i < input_vectors.size(); vector_i++) {
-            // Find min distance from cetroids
-            double min = -1;
-            for (int centroid_i = 0; centroid_i < i; centroid_i++) {
-                std::string key = input_vectors[vector_i].getId() + "to" + centroids[centroid_i]->getId();
-
-                double distance = 0;
-                if (distanceMap.count(key) == 1) {
-                    distance = distanceMap[key];
-                }
-                else {
-                    if (metric_type == "euclidean")
-                        distance = input_vectors[vector_i].euclideanDistance(centroids[centroid_i]);
-                    else if (metric_type == "cosine")
-                        distance = input_vectors[vector_i].cosineDistance(centroids[centroid_i]);
-                    distanceMap[key] = distance;
-                }
+            double distance = vector_distance(input_vectors[vector_i], centroids[i-1], metric_type);
+            if (min_dists[vector_i] == -1 || distance < min_dists[vector_i])
+                min_dists[vector_i] = distance;
+
+            weights[vector_i] = min_dists[vector_i] * min_dists[vector_i];
+        }
+
+        // Pick the next centroid with probability proportional to the squared distance
+        centroids[i] = &input_vectors[weighted_random_index(weights, rand_generator)];
+    }
+
+    return centroids;
+}
+
+
+template <typename vector_type>
+std::vector< CustVector<vector_type>* > k_means_parallel(std::vector< CustVector<vector_type> >& input_vectors,
+        int cluster_num, std::string metric_type, int rounds, double oversampling, unsigned long seed, ThreadPool& pool) {
+    // Uniform integer random stuff and rand_generator initialization
+    std::default_random_engine rand_generator(seed);
+    std::uniform_int_distribution<int> uni_int_dist(0, input_vectors.size()-1);
+
+    // Candidate centroids, as indexes of input vectors, starting with a random one
+    std::vector<int> candidates(1, uni_int_dist(rand_generator));
+
+    // Distance of each vector from its closest candidate, and which candidate that is
+    std::vector<double> min_dists(input_vectors.size(), -1);
+    std::vector<int> closest_candidates(input_vectors.size(), 0);
+
+    // Chunks are fixed, each with its own random generator, so the sampled candidates do not depend on the number of
+    // threads
+    unsigned int chunk_num = std::min(LLOYDS_CHUNK_NUM, (unsigned int) input_vectors.size());
+    std::vector<double> chunk_costs(chunk_num);
+    std::vector< std::vector<int> > chunk_samples(chunk_num);
+
+    unsigned int first_new_candidate = 0;
+    for (int round_i = 0; round_i <= rounds; round_i++) {
+        // Update the distances with the candidates added in the previous round, and sum the cost
+        pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+            unsigned int begin, end;
+            get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
 
-                if (min == -1 || distance < min)
-                    min = distance;
+            chunk_costs[chunk_i] = 0;
+            for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+                for (unsigned int candidate_i = first_new_candidate; candidate_i < candidates.size(); candidate_i++) {
+                    double distance = vector_distance(input_vectors[vector_i], &input_vectors[candidates[candidate_i]],
+                            metric_type);
+                    if (min_dists[vector_i] == -1 || distance < min_dists[vector_i]) {
+                        min_dists[vector_i] = distance;
+                        closest_candidates[vector_i] = candidate_i;
+                    }
+                }
+                chunk_costs[chunk_i] = chunk_costs[chunk_i] + min_dists[vector_i] * min_dists[vector_i];
             }
+        });
+        first_new_candidate = candidates.size();
 
-            min_dists[vector_i] = min;
+        // After the last update only the weights are needed
+        if (round_i == rounds)
+            break;
 
-            if (min > max_for_normalizing)
-                max_for_normalizing = min;
-        }
+        double cost = 0;
+        for (auto chunk_cost : chunk_costs)
+            cost = cost + chunk_cost;
+        if (cost == 0)
+            break;
 
-        // Divide all minimums with the one with the greates value for normalizing, square them and
-        // for each one, add the previous to its value
-        min_dists[0] = min_dists[0] / max_for_normalizing;
-        min_dists[0] = min_dists[0] * min_dists[0];
-        for (int min_i = 1; min_i < min_dists.size(); min_i++) {
-            min_dists[min_i] = min_dists[min_i] / max_for_normalizing;
-            min_dists[min_i] = min_dists[min_i] * min_dists[min_i];
-            min_dists[min_i] = min_dists[min_i] + min_dists[min_i-1];
-        }
+        // Oversample, every vector becomes a candidate independently, with probability proportional to its cost
+        unsigned long round_seed = rand_generator();
+        pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+            unsigned int begin, end;
+            get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
 
-        // Choose random double and perform a binary search to find the input vector whose area corresponds to it
-        std::uniform_real_distribution<double> uni_double_dist(0.0, min_dists[min_dists.size()-1]);
-        double rand_dis = uni_double_dist(rand_generator);
-        int left = 0;
-        int right = min_dists.size()-1;
-        // Custom binary search, basically search for the two numbers that the random float can be put between
-        // When found, exit and return the index of the right one, only if the random number is not lower than the first
-        int chosen_i = 0;
-        if (rand_dis > min_dists[left]) {
-            while (right - left > 1) {
-                int m = left + (right - left) / 2;
-
-                if (rand_dis <= min_dists[m])
-                    right = m;
-                else
-                    left = m;
+            std::default_random_engine chunk_generator(round_seed + chunk_i);
+            std::uniform_real_distribution<double> uni_double_dist(0.0, 1.0);
+            chunk_samples[chunk_i].clear();
+            for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+                double probability = oversampling * min_dists[vector_i] * min_dists[vector_i] / cost;
+                if (uni_double_dist(chunk_generator) < probability)
+                    chunk_samples[chunk_i].push_back(vector_i);
             }
-            chosen_i = right;
+        });
+        for (auto& chunk_sample : chunk_samples)
+            candidates.insert(candidates.end(), chunk_sample.begin(), chunk_sample.end());
+    }
+
+    // Weight every candidate by the number of vectors closest to it
+    std::vector<double> candidate_weights(candidates.size(), 0);
+    for (auto closest_candidate : closest_candidates)
+        candidate_weights[closest_candidate]++;
+
+    // Not enough candidates, fill with random vectors
+    while (candidates.size() < cluster_num) {
+        candidates.push_back(uni_int_dist(rand_generator));
+        candidate_weights.push_back(1);
+    }
+
+    // Weighted k-means++ over the candidates, to pick the final centroids
+    std::vector<CustVector<vector_type>* > centroids(cluster_num);
+    int chosen_i = weighted_random_index(candidate_weights, rand_generator);
+    centroids[0] = &input_vectors[candidates[chosen_i]];
+
+    std::vector<double> candidate_min_dists(candidates.size(), -1);
+    std::vector<double> weights(candidates.size());
+    for (int i = 1; i < cluster_num; i++) {
+        for (unsigned int candidate_i = 0; candidate_i < candidates.size(); candidate_i++) {
+            double distance = vector_distance(input_vectors[candidates[candidate_i]], centroids[i-1], metric_type);
+            if (candidate_min_dists[candidate_i] == -1 || distance < candidate_min_dists[candidate_i])
+                candidate_min_dists[candidate_i] = distance;
+
+            weights[candidate_i] = candidate_weights[candidate_i] * candidate_min_dists[candidate_i] *
+                    candidate_min_dists[candidate_i];
         }
 
-        // Add chosen centroid
-        centroids[i] = &input_vectors[chosen_i];
+        chosen_i = weighted_random_index(weights, rand_generator);
+        centroids[i] = &input_vectors[candidates[chosen_i]];
     }
 
     return centroids;
 }
 
 
+template <typename vector_type>
+double vector_distance(CustVector<vector_type>& in_vector, CustVector<vector_type>* other, const std::string& metric_type) {
+    if (metric_type == "euclidean")
+        return in_vector.euclideanDistance(other);
+    else if (metric_type == "cosine")
+        return in_vector.cosineDistance(other);
+
+    return 0;
+}
+
+
+inline int weighted_random_index(std::vector<double>& weights, std::default_random_engine& rand_generator) {
+    // Cumulative weights, then choose a random number and find its place with a binary search
+    std::vector<double> cumulative(weights.size());
+    double sum = 0;
+    for (unsigned int i = 0; i < weights.size(); i++) {
+        sum = sum + weights[i];
+        cumulative[i] = sum;
+    }
+
+    // If all weights are zero, every index is as likely
+    if (sum == 0) {
+        std::uniform_int_distribution<int> uni_int_dist(0, weights.size()-1);
+        return uni_int_dist(rand_generator);
+    }
+
+    std::uniform_real_distribution<double> uni_double_dist(0.0, sum);
+    double rand_dis = uni_double_dist(rand_generator);
+    int chosen_i = std::lower_bound(cumulative.begin(), cumulative.end(), rand_dis) - cumulative.begin();
+    if (chosen_i >= (int) weights.size())
+        chosen_i = weights.size() - 1;
+
+    return chosen_i;
+}
+
+
 #endif //CLUSTER_INITIALIZATION_H
@@ -5,9 +5,15 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <random>
 
 #include "../data_structures/cust_vector.hpp"
 #include "../data_structures/cust_hashtable.hpp"
+#include "../data_structures/distance_cache.h"
+#include "../data_structures/user_matrix.hpp"
+#include "../parallel/thread_pool.h"
 
 #include "../lsh_cube.hpp"
 
@@ -16,20 +22,63 @@
  * Templated, so it can be used for any kind of input vector type
  */
 
+
+// Number of rows in each side of a distance tile of the parallel silhouette
+const unsigned int SILHOUETTE_TILE_ROWS = 64;
+
+// Silhouette of every cluster, with the overall silhouette as the last element
+// b(i) is calculated with the cluster whose centroid is closest to the centroid of the vector's cluster
 template <typename vector_type>
-std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vector_type>* > > clusters, std::vector< CustVector<vector_type>* >& centroids,
+std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vector_type>* > >& clusters, std::vector< CustVector<vector_type>* >& centroids,
                   std::string metric_type);
 
+// Same result as silhouette_cluster, for input vectors that are already assigned to clusters
+// The vectors are copied into the contiguous rows of a UserMatrix, sorted by cluster, and the threads of the pool each
+// take a block of rows of a cluster, summing their distances from the rows of their own and of the neighboring
+// cluster one tile of rows at a time, so that both blocks stay in cache
+template <typename vector_type>
+std::vector<double> parallel_silhouette(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, ThreadPool& pool);
+
+// Estimate of the overall silhouette, as the mean silhouette of sample_num randomly chosen vectors, so that it can
+// be calculated on every run
+// The half width of the 95% confidence interval of the estimate is written to confidence_interval
+template <typename vector_type>
+double sampled_silhouette(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, int sample_num, unsigned long seed,
+        ThreadPool& pool, double* confidence_interval);
+
+// Rows of the input vectors sorted by cluster, with cluster_offsets[c] being the first row of cluster c and the last
+// element the number of rows, the neighboring cluster of each one and, for cosine, the norm of each row
+template <typename vector_type>
+void silhouette_rows(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, UserMatrix<vector_type>& rows,
+        std::vector<unsigned int>& cluster_offsets, std::vector<int>& near_centroid_i, std::vector<double>& norms);
+
+// Add the distances of rows [i_begin, i_end) from rows [j_begin, j_end) to dist_sums, one element for each i row
+template <typename vector_type>
+void silhouette_tile(UserMatrix<vector_type>& rows, std::vector<double>& norms, unsigned int i_begin,
+        unsigned int i_end, unsigned int j_begin, unsigned int j_end, const std::string& metric_type, double* dist_sums);
+
+// Silhouette of each of the rows [i_begin, i_end) of a cluster, given the row ranges of the cluster and its neighbor
+template <typename vector_type>
+void silhouette_of_rows(UserMatrix<vector_type>& rows, std::vector<double>& norms, unsigned int i_begin,
+        unsigned int i_end, unsigned int cluster_begin, unsigned int cluster_end, unsigned int neighbor_begin,
+        unsigned int neighbor_end, const std::string& metric_type, double* sils);
+
+// Silhouette of one vector of a cluster, given the closest other cluster
+// Vectors are identified in the distance cache by the offset of their cluster plus their position in it
 template <typename vector_type>
 double silhouette_of_i(std::vector< CustVector<vector_type>* >& cluster, int sil_vector_i,
-        std::vector< CustVector<vector_type>* >& neighbor_cluster, std::string metric_type, std::unordered_map<std::string, double>& distanceMap);
+        std::vector< CustVector<vector_type>* >& neighbor_cluster, std::string metric_type, DistanceCache& distanceCache,
+        unsigned int cluster_offset, unsigned int neighbor_offset);
 
 /*
 * Function definitions
 */
 
 template <typename vector_type>
-std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vector_type>* > > clusters, std::vector< CustVector<vector_type>* >& centroids,
+std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vector_type>* > >& clusters, std::vector< CustVector<vector_type>* >& centroids,
                 std::string metric_type) {
 
     // First, for each centroid, find its nearest
@@ -57,9 +106,16 @@ std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vect
         near_centroid_i[centroid_i] = min_centroid_i;
     }
 
-    // Use map to cache calculated distances (all calculated distances are very likely to be used a lot more than once,
+    // Cache calculated distances (all calculated distances are very likely to be used a lot more than once,
     // even the distances between neighboring cluster vectors)
-    std::unordered_map<std::string, double> distanceMap;
+    // Each vector is indexed by the offset of its cluster plus its position in the cluster
+    std::vector<unsigned int> cluster_offsets(clusters.size());
+    unsigned int all_vector_num = 0;
+    for (int cluster_i = 0; cluster_i < clusters.size(); cluster_i++) {
+        cluster_offsets[cluster_i] = all_vector_num;
+        all_vector_num = all_vector_num + clusters[cluster_i].size();
+    }
+    DistanceCache distanceCache(all_vector_num);
 
     std::vector<double> sils(clusters.size()+1);
     sils[clusters.size()] = 0;
@@ -69,7 +125,7 @@ std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vect
         sils[cluster_i] = 0;
         for (int vec_i = 0; vec_i < clusters[cluster_i].size(); vec_i++)
             sils[cluster_i] = sils[cluster_i] + silhouette_of_i(clusters[cluster_i], vec_i, clusters[near_centroid_i[cluster_i]],
-                    metric_type, distanceMap);
+                    metric_type, distanceCache, cluster_offsets[cluster_i], cluster_offsets[near_centroid_i[cluster_i]]);
         sils[clusters.size()] = sils[clusters.size()] + sils[cluster_i];
         sils[cluster_i] = sils[cluster_i] / clusters[cluster_i].size();
 
@@ -83,27 +139,20 @@ std::vector<double> silhouette_cluster(std::vector< std::vector< CustVector<vect
 
 template <typename vector_type>
 double silhouette_of_i(std::vector< CustVector<vector_type>* >& cluster, int sil_vector_i,
-        std::vector< CustVector<vector_type>* >& neighbor_cluster, std::string metric_type,
-        std::unordered_map<std::string, double>& distanceMap) {
+        std::vector< CustVector<vector_type>* >& neighbor_cluster, std::string metric_type, DistanceCache& distanceCache,
+        unsigned int cluster_offset, unsigned int neighbor_offset) {
 
     // Calculate a(i)
     double a_i = 0;
     for (int cluster_i = 0; cluster_i < cluster.size(); cluster_i++) {
-        std::string key = cluster[sil_vector_i]->getId() + "to" + cluster[cluster_i]->getId();
-        std::string reverse_key = cluster[cluster_i]->getId() + "to" + cluster[sil_vector_i]->getId();
-
         double distance = 0;
-        if (distanceMap.count(key) == 1) {
-            distance = distanceMap[key];
-        }
-        // If distance is not in the map, calculate and save it (with the reverse key, as it will not be needed a
-        // second time for this particular vector
-        else {
+        // If distance is not cached, calculate and save it
+        if (!distanceCache.get(cluster_offset + sil_vector_i, cluster_offset + cluster_i, &distance)) {
             if (metric_type == "euclidean")
                 distance = cluster[sil_vector_i]->euclideanDistance(cluster[cluster_i]);
             else if (metric_type == "cosine")
                 distance = cluster[sil_vector_i]->cosineDistance(cluster[cluster_i]);
-            distanceMap[reverse_key] = distance;
+            distanceCache.set(cluster_offset + sil_vector_i, cluster_offset + cluster_i, distance);
         }
 
         a_i = a_i + distance;
@@ -114,21 +163,14 @@ double silhouette_of_i(std::vector< CustVector<vector_type>* >& cluster, int sil
     // Calculate b(i)
     double b_i = 0;
     for (int neig_cluster_i = 0; neig_cluster_i < neighbor_cluster.size(); neig_cluster_i++) {
-        std::string key = cluster[sil_vector_i]->getId() + "to" + neighbor_cluster[neig_cluster_i]->getId();
-        std::string reverse_key = neighbor_cluster[neig_cluster_i]->getId() + "to" + cluster[sil_vector_i]->getId();
-
         double distance = 0;
-        if (distanceMap.count(key) == 1) {
-            distance = distanceMap[key];
-        }
-        // If distance is not in the map, calculate and save it (with the reverse key, as it will not be needed a
-        // second time for this particular vector
-        else {
+        // If distance is not cached, calculate and save it
+        if (!distanceCache.get(cluster_offset + sil_vector_i, neighbor_offset + neig_cluster_i, &distance)) {
             if (metric_type == "euclidean")
                 distance = cluster[sil_vector_i]->euclideanDistance(neighbor_cluster[neig_cluster_i]);
             else if (metric_type == "cosine")
                 distance = cluster[sil_vector_i]->cosineDistance(neighbor_cluster[neig_cluster_i]);
-            distanceMap[reverse_key] = distance;
+            distanceCache.set(cluster_offset + sil_vector_i, neighbor_offset + neig_cluster_i, distance);
         }
 
         b_i = b_i + distance;
@@ -144,6 +186,207 @@ double silhouette_of_i(std::vector< CustVector<vector_type>* >& cluster, int sil
 }
 
 
+template <typename vector_type>
+std::vector<double> parallel_silhouette(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, ThreadPool& pool) {
+    UserMatrix<vector_type> rows(input_vectors.size(), centroids[0]->getDimNumber());
+    std::vector<unsigned int> cluster_offsets;
+    std::vector<int> near_centroid_i;
+    std::vector<double> norms;
+    silhouette_rows(input_vectors, centroids, metric_type, rows, cluster_offsets, near_centroid_i, norms);
+
+    // Split every cluster in blocks of tile rows, each block is one task for the pool
+    std::vector<unsigned int> block_begins;
+    std::vector<int> block_clusters;
+    for (unsigned int cluster_i = 0; cluster_i < centroids.size(); cluster_i++) {
+        for (unsigned int begin = cluster_offsets[cluster_i]; begin < cluster_offsets[cluster_i+1]; begin += SILHOUETTE_TILE_ROWS) {
+            block_begins.push_back(begin);
+            block_clusters.push_back(cluster_i);
+        }
+    }
+
+    // Each task writes the silhouettes of its own rows only
+    std::vector<double> row_sils(rows.getRowNumber());
+    pool.parallelFor(block_begins.size(), [&](unsigned int block_i) {
+        int cluster_i = block_clusters[block_i];
+        int neighbor_i = near_centroid_i[cluster_i];
+        unsigned int begin = block_begins[block_i];
+        unsigned int end = std::min(begin + SILHOUETTE_TILE_ROWS, cluster_offsets[cluster_i+1]);
+
+        silhouette_of_rows(rows, norms, begin, end, cluster_offsets[cluster_i], cluster_offsets[cluster_i+1],
+                cluster_offsets[neighbor_i], cluster_offsets[neighbor_i+1], metric_type, &row_sils[begin]);
+    });
+
+    // Per cluster and overall means, in row order so that the result does not depend on the number of threads
+    std::vector<double> sils(centroids.size()+1);
+    sils[centroids.size()] = 0;
+    for (unsigned int cluster_i = 0; cluster_i < centroids.size(); cluster_i++) {
+        sils[cluster_i] = 0;
+        for (unsigned int row_i = cluster_offsets[cluster_i]; row_i < cluster_offsets[cluster_i+1]; row_i++)
+            sils[cluster_i] = sils[cluster_i] + row_sils[row_i];
+        sils[centroids.size()] = sils[centroids.size()] + sils[cluster_i];
+        sils[cluster_i] = sils[cluster_i] / (cluster_offsets[cluster_i+1] - cluster_offsets[cluster_i]);
+    }
+    sils[centroids.size()] = sils[centroids.size()] / rows.getRowNumber();
+
+    return sils;
+}
+
+
+template <typename vector_type>
+double sampled_silhouette(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, int sample_num, unsigned long seed,
+        ThreadPool& pool, double* confidence_interval) {
+    UserMatrix<vector_type> rows(input_vectors.size(), centroids[0]->getDimNumber());
+    std::vector<unsigned int> cluster_offsets;
+    std::vector<int> near_centroid_i;
+    std::vector<double> norms;
+    silhouette_rows(input_vectors, centroids, metric_type, rows, cluster_offsets, near_centroid_i, norms);
+
+    // Uniform integer random stuff and rand_generator initialization, the samples are drawn from the seed
+    std::default_random_engine rand_generator(seed);
+    std::uniform_int_distribution<int> uni_int_dist(0, rows.getRowNumber()-1);
+
+    std::vector<unsigned int> sample_rows(sample_num);
+    for (int i = 0; i < sample_num; i++)
+        sample_rows[i] = uni_int_dist(rand_generator);
+
+    // Cluster of each row, found from the offsets
+    std::vector<int> sample_clusters(sample_num);
+    for (int i = 0; i < sample_num; i++)
+        sample_clusters[i] = std::upper_bound(cluster_offsets.begin(), cluster_offsets.end(), sample_rows[i]) -
+                cluster_offsets.begin() - 1;
+
+    std::vector<double> sample_sils(sample_num);
+    pool.parallelFor(sample_num, [&](unsigned int i) {
+        int cluster_i = sample_clusters[i];
+        int neighbor_i = near_centroid_i[cluster_i];
+        silhouette_of_rows(rows, norms, sample_rows[i], sample_rows[i] + 1, cluster_offsets[cluster_i],
+                cluster_offsets[cluster_i+1], cluster_offsets[neighbor_i], cluster_offsets[neighbor_i+1], metric_type,
+                &sample_sils[i]);
+    });
+
+    // Sample mean and the half width of its 95% confidence interval
+    double mean = 0;
+    for (auto sample_sil : sample_sils)
+        mean = mean + sample_sil;
+    mean = mean / sample_num;
+
+    double variance = 0;
+    for (auto sample_sil : sample_sils)
+        variance = variance + (sample_sil - mean) * (sample_sil - mean);
+    if (sample_num > 1)
+        variance = variance / (sample_num - 1);
+
+    *confidence_interval = 1.96 * sqrt(variance / sample_num);
+    return mean;
+}
+
+
+template <typename vector_type>
+void silhouette_rows(std::vector< CustVector<vector_type> >& input_vectors,
+        std::vector< CustVector<vector_type>* >& centroids, std::string metric_type, UserMatrix<vector_type>& rows,
+        std::vector<unsigned int>& cluster_offsets, std::vector<int>& near_centroid_i, std::vector<double>& norms) {
+    unsigned int cluster_num = centroids.size();
+    unsigned int dim_num = rows.getDimNumber();
+
+    // Counting sort of the input vectors by cluster
+    cluster_offsets.assign(cluster_num + 1, 0);
+    for (auto& in_vector : input_vectors)
+        cluster_offsets[in_vector.getCluster() + 1]++;
+    for (unsigned int cluster_i = 0; cluster_i < cluster_num; cluster_i++)
+        cluster_offsets[cluster_i + 1] = cluster_offsets[cluster_i + 1] + cluster_offsets[cluster_i];
+
+    std::vector<unsigned int> next_rows(cluster_offsets.begin(), cluster_offsets.end() - 1);
+    for (auto& in_vector : input_vectors) {
+        unsigned int row_i = next_rows[in_vector.getCluster()]++;
+        vector_type* row_data = rows.getRowData(row_i);
+        std::vector<vector_type>* in_dims = in_vector.getDimensions();
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+            row_data[dim_i] = (*in_dims)[dim_i];
+    }
+
+    // Same as silhouette_cluster, the neighbor of each cluster is the one with the closest centroid
+    near_centroid_i.assign(cluster_num, 0);
+    for (unsigned int centroid_i = 0; centroid_i < cluster_num; centroid_i++) {
+        double min_distance = -1;
+        for (unsigned int i = 0; i < cluster_num; i++) {
+            if (i != centroid_i) {
+                double distance = 0;
+                if (metric_type == "euclidean")
+                    distance = centroids[centroid_i]->euclideanDistance(centroids[i]);
+                else if (metric_type == "cosine")
+                    distance = centroids[centroid_i]->cosineDistance(centroids[i]);
+
+                if (min_distance == -1 || distance < min_distance) {
+                    min_distance = distance;
+                    near_centroid_i[centroid_i] = i;
+                }
+            }
+        }
+    }
+
+    // Cosine distances only need an inner product per pair if the norms are known
+    norms.assign(rows.getRowNumber(), 0);
+    if (metric_type == "cosine") {
+        for (unsigned int row_i = 0; row_i < rows.getRowNumber(); row_i++)
+            norms[row_i] = sqrt(dot_kernel(rows.getRowData(row_i), rows.getRowData(row_i), dim_num));
+    }
+}
+
+
+template <typename vector_type>
+void silhouette_tile(UserMatrix<vector_type>& rows, std::vector<double>& norms, unsigned int i_begin,
+        unsigned int i_end, unsigned int j_begin, unsigned int j_end, const std::string& metric_type, double* dist_sums) {
+    unsigned int dim_num = rows.getDimNumber();
+    bool euclidean = (metric_type == "euclidean");
+
+    for (unsigned int i = i_begin; i < i_end; i++) {
+        vector_type* i_data = rows.getRowData(i);
+        double dist_sum = 0;
+        for (unsigned int j = j_begin; j < j_end; j++) {
+            if (euclidean)
+                dist_sum = dist_sum + sqrt(squared_l2_kernel(i_data, rows.getRowData(j), dim_num));
+            else
+                dist_sum = dist_sum + 1 - dot_kernel(i_data, rows.getRowData(j), dim_num) / (norms[i] * norms[j]);
+        }
+        dist_sums[i - i_begin] = dist_sums[i - i_begin] + dist_sum;
+    }
+}
+
+
+template <typename vector_type>
+void silhouette_of_rows(UserMatrix<vector_type>& rows, std::vector<double>& norms, unsigned int i_begin,
+        unsigned int i_end, unsigned int cluster_begin, unsigned int cluster_end, unsigned int neighbor_begin,
+        unsigned int neighbor_end, const std::string& metric_type, double* sils) {
+    std::vector<double> a_sums(i_end - i_begin, 0);
+    std::vector<double> b_sums(i_end - i_begin, 0);
+
+    // a(i) over the own cluster and b(i) over the neighboring one, one tile of rows at a time
+    for (unsigned int j_begin = cluster_begin; j_begin < cluster_end; j_begin += SILHOUETTE_TILE_ROWS)
+        silhouette_tile(rows, norms, i_begin, i_end, j_begin, std::min(j_begin + SILHOUETTE_TILE_ROWS, cluster_end),
+                metric_type, a_sums.data());
+    for (unsigned int j_begin = neighbor_begin; j_begin < neighbor_end; j_begin += SILHOUETTE_TILE_ROWS)
+        silhouette_tile(rows, norms, i_begin, i_end, j_begin, std::min(j_begin + SILHOUETTE_TILE_ROWS, neighbor_end),
+                metric_type, b_sums.data());
+
+    unsigned int cluster_size = cluster_end - cluster_begin;
+    unsigned int neighbor_size = neighbor_end - neighbor_begin;
+    for (unsigned int i = 0; i < i_end - i_begin; i++) {
+        double a_i = a_sums[i];
+        if (cluster_size != 1)
+            a_i = a_i / (cluster_size - 1);
+        double b_i = b_sums[i] / neighbor_size;
+
+        double max_i = a_i;
+        if (b_i > a_i)
+            max_i = b_i;
+
+        sils[i] = (b_i - a_i) / max_i;
+    }
+}
+
+
 
 
 
@@ -5,8 +5,18 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <random>
 
 #include "../data_structures/cust_vector.hpp"
+#include "../data_structures/cluster_sums.hpp"
+#include "../data_structures/kmeans_centers.hpp"
+#include "../data_structures/kmeans_bounds.h"
+#include "../data_structures/distance_cache.h"
+#include "../parallel/thread_pool.h"
+
+#include "assignment.hpp"
 
 /*
  * Functions used to implement various update algorithms required for vector clustering
@@ -14,6 +24,11 @@
  * All functions are templated, so they can be used for any kind of input vector type
  */
 
+
+// Bounds gather rounding errors over the iterations, so a vector is only skipped when its upper bound is below the
+// limit by this factor, keeping the assignments identical to Lloyd's
+const double HAMERLY_BOUND_SLACK = 1 + 1e-9;
+
 // K_means update algorithm, for each cluster, calculates the mean of all its members and creates vectors found dimensions
 // If clustering should stop (same centers are found, or previous and new centers do not exceed a minimum distance)
 // return false, otherwise true
@@ -22,6 +37,42 @@ template <typename vector_type>
 bool k_means(std::vector< CustVector<vector_type> >& input_vectors, std::vector< CustVector<vector_type>* >& centroids,
         std::string metric_type, double min_dist);
 
+// Lloyd's assignment and k_means update fused in a single pass over the input vectors
+// Each vector is assigned to its closest center and added to the sums of that cluster at the same time, in parallel
+// chunks, then the new centers are calculated into the preallocated buffers and swapped with the current ones if at
+// least one moved more than min_dist, in which case true is returned so that clustering continues
+// Nothing is allocated, all buffers are part of the KMeansCenters object
+template <typename vector_type>
+bool lloyds_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        std::string metric_type, double min_dist, ThreadPool& pool);
+
+// Second half of the fused algorithms, merge the chunk sums into the next centers, store how much each center moved
+// and swap the centers if at least one moved more than min_dist, in which case true is returned
+template <typename vector_type>
+bool update_k_means_centers(KMeansCenters<vector_type>& centers, std::string metric_type, double min_dist);
+
+// Fused assignment and k_means update like lloyds_k_means, for euclidean distance only, with the assignment
+// accelerated by Hamerly's bounds, kept between iterations in a KMeansBounds object
+// Distances from centers that the bounds prove cannot be closer are not calculated, assignments are the same as
+// Lloyd's, how many were calculated and how many were skipped is counted by the bounds object
+// The distance from the centroid of a vector that the bounds alone kept in its cluster is its upper bound, not the
+// exact distance
+template <typename vector_type>
+bool hamerly_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        KMeansBounds& bounds, double min_dist, ThreadPool& pool);
+
+// Mini-batch k-means, instead of going over all input vectors in each iteration, take a random batch of them, assign
+// it to the current centers and move each center towards the batch vectors assigned to it, with a learning rate of one
+// over the number of vectors that the center has been moved towards so far
+// Stops after max_batches, when no center moved more than min_dist during a batch, or when the smoothed batch
+// inertia (sum of distances from centers) has not improved for patience batches
+// Afterwards all input vectors are assigned to the final centers, and the number of batches used is returned
+// The result is approximate, but much faster than k_means for large inputs
+template <typename vector_type>
+int mini_batch_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        std::string metric_type, int batch_size, int max_batches, int patience, double min_dist, unsigned long seed,
+        ThreadPool& pool);
+
 // Pam algorithm improved like Lloyd's, for each cluster, calculate the median that minimizes the distance of all other
 // vectors of the cluster and it, then switch the current centroid with it
 // If clustering should stop (same centroids are found) return false, otherwise true
@@ -86,6 +137,298 @@ bool k_means(std::vector< CustVector<vector_type> >& input_vectors, std::vector<
 }
 
 
+template <typename vector_type>
+bool lloyds_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        std::string metric_type, double min_dist, ThreadPool& pool) {
+    std::vector< CustVector<vector_type>* >& curr_centers = centers.getCenters();
+    unsigned int chunk_num = centers.getChunkNumber();
+
+    // Assignment and summing of every chunk, each one writes only its own vectors and sums
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        ClusterSums<vector_type>& chunk_sums = centers.getChunkSums(chunk_i);
+        chunk_sums.reset();
+
+        unsigned int begin, end;
+        get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
+        for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+            double min = 0;
+            int min_centroid_i = nearest_centroid(input_vectors[vector_i], curr_centers, metric_type, &min);
+            input_vectors[vector_i].setCluster(min_centroid_i, min);
+            chunk_sums.addVector(min_centroid_i, input_vectors[vector_i].getDimensions()->data());
+        }
+    });
+
+    return update_k_means_centers(centers, metric_type, min_dist);
+}
+
+
+template <typename vector_type>
+bool update_k_means_centers(KMeansCenters<vector_type>& centers, std::string metric_type, double min_dist) {
+    std::vector< CustVector<vector_type>* >& curr_centers = centers.getCenters();
+    unsigned int chunk_num = centers.getChunkNumber();
+
+    // Merge chunk sums in order, so the centers do not depend on the number of threads
+    ClusterSums<vector_type>& cluster_sums = centers.getChunkSums(0);
+    for (unsigned int chunk_i = 1; chunk_i < chunk_num; chunk_i++)
+        cluster_sums.addSums(centers.getChunkSums(chunk_i));
+
+    // Calculate the next centers and check if any of them moved enough for clustering to continue
+    bool continue_clustering = false;
+    unsigned int dim_num = cluster_sums.getDimNumber();
+    for (unsigned int cluster_i = 0; cluster_i < curr_centers.size(); cluster_i++) {
+        CustVector<vector_type>* nextCenter = centers.getNextCenter(cluster_i);
+        std::vector<vector_type>* next_dims = nextCenter->getDimensions();
+        vector_type* sums = cluster_sums.getSums(cluster_i);
+        int member_num = cluster_sums.getMemberNum(cluster_i);
+
+        for (unsigned int i = 0; i < dim_num; i++)
+            (*next_dims)[i] = (member_num != 0) ? sums[i] / member_num : sums[i];
+        nextCenter->updateNorm();
+
+        double distance = 0;
+        if (metric_type == "euclidean")
+            distance = nextCenter->euclideanDistance(curr_centers[cluster_i]);
+        else if (metric_type == "cosine")
+            distance = nextCenter->cosineDistance(curr_centers[cluster_i]);
+
+        centers.setCenterMove(cluster_i, distance);
+        if (distance > min_dist)
+            continue_clustering = true;
+    }
+
+    if (continue_clustering)
+        centers.swapCenters();
+
+    return continue_clustering;
+}
+
+
+template <typename vector_type>
+bool hamerly_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        KMeansBounds& bounds, double min_dist, ThreadPool& pool) {
+    std::vector< CustVector<vector_type>* >& curr_centers = centers.getCenters();
+    unsigned int cluster_num = curr_centers.size();
+    unsigned int chunk_num = centers.getChunkNumber();
+
+    // Half the distance of each center from its closest other center, a vector closer than that to its own center
+    // cannot be closer to any other one
+    for (unsigned int cluster_i = 0; cluster_i < cluster_num; cluster_i++) {
+        double min = std::numeric_limits<double>::max();
+        for (unsigned int other_i = 0; other_i < cluster_num; other_i++) {
+            if (other_i != cluster_i) {
+                double distance = curr_centers[cluster_i]->euclideanDistance(curr_centers[other_i]);
+                if (distance < min)
+                    min = distance;
+            }
+        }
+        bounds.setHalfCenterDist(cluster_i, min / 2);
+    }
+
+    // The lower bound of a vector is for all centers except its own, so it is lowered by the largest move of any
+    // other center
+    int max_move_i = 0;
+    double max_move = 0;
+    double second_max_move = 0;
+    for (unsigned int cluster_i = 0; cluster_i < cluster_num; cluster_i++) {
+        double move = centers.getCenterMove(cluster_i);
+        if (move > max_move) {
+            second_max_move = max_move;
+            max_move = move;
+            max_move_i = cluster_i;
+        }
+        else if (move > second_max_move)
+            second_max_move = move;
+    }
+
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        ClusterSums<vector_type>& chunk_sums = centers.getChunkSums(chunk_i);
+        chunk_sums.reset();
+        unsigned long computed_num = 0;
+        unsigned long pruned_num = 0;
+
+        unsigned int begin, end;
+        get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
+        for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+            CustVector<vector_type>& in_vector = input_vectors[vector_i];
+            bool assigned = false;
+
+            if (bounds.isInitialized()) {
+                int cluster_i = in_vector.getCluster();
+                double upper = bounds.getUpperBound(vector_i) + centers.getCenterMove(cluster_i);
+                double lower = bounds.getLowerBound(vector_i) - (cluster_i == max_move_i ? second_max_move : max_move);
+                double limit = std::max(bounds.getHalfCenterDist(cluster_i), lower);
+
+                // First try with the bounds alone, then with the exact distance from the current center
+                if (upper * HAMERLY_BOUND_SLACK < limit) {
+                    pruned_num = pruned_num + cluster_num;
+                    assigned = true;
+                }
+                else {
+                    upper = in_vector.euclideanDistance(curr_centers[cluster_i]);
+                    computed_num++;
+                    if (upper * HAMERLY_BOUND_SLACK < limit) {
+                        pruned_num = pruned_num + cluster_num - 1;
+                        assigned = true;
+                    }
+                }
+
+                // The distance kept for vectors that did not need checking is its upper bound
+                if (assigned) {
+                    bounds.setBounds(vector_i, upper, lower);
+                    in_vector.setCluster(cluster_i, upper);
+                }
+            }
+
+            // Same as Lloyd's, but keep the second closest distance as the lower bound
+            if (!assigned) {
+                double min = -1;
+                double second_min = std::numeric_limits<double>::max();
+                int min_centroid_i = 0;
+                for (unsigned int centroid_i = 0; centroid_i < cluster_num; centroid_i++) {
+                    double distance = in_vector.euclideanDistance(curr_centers[centroid_i]);
+                    if (min == -1 || distance < min) {
+                        if (min != -1)
+                            second_min = min;
+                        min = distance;
+                        min_centroid_i = centroid_i;
+                    }
+                    else if (distance < second_min)
+                        second_min = distance;
+                }
+                computed_num = computed_num + cluster_num;
+
+                bounds.setBounds(vector_i, min, second_min);
+                in_vector.setCluster(min_centroid_i, min);
+            }
+
+            chunk_sums.addVector(in_vector.getCluster(), in_vector.getDimensions()->data());
+        }
+
+        bounds.addComputed(chunk_i, computed_num);
+        bounds.addPruned(chunk_i, pruned_num);
+    });
+    bounds.setInitialized();
+
+    return update_k_means_centers(centers, "euclidean", min_dist);
+}
+
+
+template <typename vector_type>
+int mini_batch_k_means(std::vector< CustVector<vector_type> >& input_vectors, KMeansCenters<vector_type>& centers,
+        std::string metric_type, int batch_size, int max_batches, int patience, double min_dist, unsigned long seed,
+        ThreadPool& pool) {
+    // Uniform integer random stuff and rand_generator initialization, batches are drawn from the seed
+    std::default_random_engine rand_generator(seed);
+    std::uniform_int_distribution<int> uni_int_dist(0, input_vectors.size()-1);
+
+    std::vector< CustVector<vector_type>* >& curr_centers = centers.getCenters();
+    unsigned int cluster_num = curr_centers.size();
+    unsigned int dim_num = curr_centers[0]->getDimNumber();
+    unsigned int chunk_num = std::min((unsigned int) batch_size, centers.getChunkNumber());
+
+    // Number of vectors that each center has been moved towards, its learning rate is one over it
+    std::vector<long> center_counts(cluster_num, 0);
+    std::vector<int> batch_indexes(batch_size);
+    std::vector<int> batch_clusters(batch_size);
+    std::vector<double> chunk_inertias(chunk_num);
+
+    // Weight of each batch in the smoothed inertia, larger batches are more reliable
+    double smooth_weight = std::min(1.0, 2.0 * batch_size / input_vectors.size());
+    double smoothed_inertia = -1;
+    double best_inertia = -1;
+    int no_improvement_num = 0;
+
+    int batch_i = 0;
+    while (batch_i < max_batches) {
+        batch_i++;
+        for (int i = 0; i < batch_size; i++)
+            batch_indexes[i] = uni_int_dist(rand_generator);
+
+        // Assign the whole batch to the centers as they are before this batch
+        pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+            unsigned int begin, end;
+            get_chunk_bounds(batch_size, chunk_num, chunk_i, &begin, &end);
+
+            chunk_inertias[chunk_i] = 0;
+            for (unsigned int i = begin; i < end; i++) {
+                double min = 0;
+                batch_clusters[i] = nearest_centroid(input_vectors[batch_indexes[i]], curr_centers, metric_type, &min);
+                chunk_inertias[chunk_i] = chunk_inertias[chunk_i] + min;
+            }
+        });
+
+        // Keep the centers before the batch in the next centers buffer, to measure how much they move
+        for (unsigned int cluster_i = 0; cluster_i < cluster_num; cluster_i++) {
+            *(centers.getNextCenter(cluster_i)->getDimensions()) = *(curr_centers[cluster_i]->getDimensions());
+            centers.getNextCenter(cluster_i)->updateNorm();
+        }
+
+        // Move each center towards its batch vectors, with its own learning rate
+        for (int i = 0; i < batch_size; i++) {
+            int cluster_i = batch_clusters[i];
+            center_counts[cluster_i]++;
+            double learning_rate = 1.0 / center_counts[cluster_i];
+
+            std::vector<vector_type>* center_dims = curr_centers[cluster_i]->getDimensions();
+            std::vector<vector_type>* in_dims = input_vectors[batch_indexes[i]].getDimensions();
+            for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+                (*center_dims)[dim_i] = (*center_dims)[dim_i] + learning_rate * ((*in_dims)[dim_i] - (*center_dims)[dim_i]);
+        }
+
+        // Early stopping, either the centers stopped moving or the inertia stopped improving
+        double max_move = 0;
+        for (unsigned int cluster_i = 0; cluster_i < cluster_num; cluster_i++) {
+            curr_centers[cluster_i]->updateNorm();
+
+            double distance = 0;
+            if (metric_type == "euclidean")
+                distance = curr_centers[cluster_i]->euclideanDistance(centers.getNextCenter(cluster_i));
+            else if (metric_type == "cosine")
+                distance = curr_centers[cluster_i]->cosineDistance(centers.getNextCenter(cluster_i));
+            if (distance > max_move)
+                max_move = distance;
+        }
+        if (max_move <= min_dist)
+            break;
+
+        double inertia = 0;
+        for (auto chunk_inertia : chunk_inertias)
+            inertia = inertia + chunk_inertia;
+        inertia = inertia / batch_size;
+
+        if (smoothed_inertia == -1)
+            smoothed_inertia = inertia;
+        else
+            smoothed_inertia = smoothed_inertia * (1 - smooth_weight) + inertia * smooth_weight;
+
+        if (best_inertia == -1 || smoothed_inertia < best_inertia) {
+            best_inertia = smoothed_inertia;
+            no_improvement_num = 0;
+        }
+        else {
+            no_improvement_num++;
+            if (no_improvement_num >= patience)
+                break;
+        }
+    }
+
+    // Assign all input vectors to the final centers
+    chunk_num = centers.getChunkNumber();
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        unsigned int begin, end;
+        get_chunk_bounds(input_vectors.size(), chunk_num, chunk_i, &begin, &end);
+
+        for (unsigned int vector_i = begin; vector_i < end; vector_i++) {
+            double min = 0;
+            int min_centroid_i = nearest_centroid(input_vectors[vector_i], curr_centers, metric_type, &min);
+            input_vectors[vector_i].setCluster(min_centroid_i, min);
+        }
+    });
+
+    return batch_i;
+}
+
+
 template <typename vector_type>
 bool pam_lloyds(std::vector< CustVector<vector_type> >& input_vectors, std::vector< CustVector<vector_type>* >& centroids,
                 std::string metric_type) {
@@ -98,26 +441,21 @@ bool pam_lloyds(std::vector< CustVector<vector_type> >& input_vectors, std::vect
     for (int cluster_i = 0; cluster_i < clusters.size(); cluster_i++) {
         double min_dist_sum = -1;
         int min_dist_i = 0;
-        // Dictionary to cache distances
-        std::unordered_map<std::string, double> distanceMap;
+        // Cache distances, vectors are indexed by their position in the cluster
+        DistanceCache distanceCache(clusters[cluster_i].size());
         for (int pot_median_i = 0; pot_median_i < clusters[cluster_i].size(); pot_median_i++) {
             double dist_sum = 0;
             for (int curr_dist_i = 0; curr_dist_i < clusters[cluster_i].size(); curr_dist_i++) {
                 double distance = 0;
 
-                std::string key = clusters[cluster_i][pot_median_i]->getId() + "to" + clusters[cluster_i][curr_dist_i]->getId();
-                std::string reverse_key = clusters[cluster_i][curr_dist_i]->getId() + "to" + clusters[cluster_i][pot_median_i]->getId();
-                if (distanceMap.count(key) == 1) {
-                    distance = distanceMap[key];
-                }
-                // Else calculate distance and save it in the map
-                else {
+                // If not cached, calculate distance and save it
+                if (!distanceCache.get(pot_median_i, curr_dist_i, &distance)) {
                     if (metric_type == "euclidean")
                         distance = clusters[cluster_i][pot_median_i]->euclideanDistance(clusters[cluster_i][curr_dist_i]);
                     else if (metric_type == "cosine")
                         distance = clusters[cluster_i][pot_median_i]->cosineDistance(clusters[cluster_i][curr_dist_i]);
 
-                    distanceMap[reverse_key] = distance;
+                    distanceCache.set(pot_median_i, curr_dist_i, distance);
                 }
                 dist_sum = dist_sum + distance;
             }
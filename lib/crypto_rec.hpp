@@ -6,10 +6,13 @@
 #include <vector>
 #include <unordered_map>
 #include <cmath>
-#include <ctime>
+#include <random>
+#include <algorithm>
+#include <utility>
 
 #include "./data_structures/cust_vector.hpp"
 #include "./data_structures/tweet.h"
+#include "./data_structures/user_sentiments.h"
 #include "lsh_cube.hpp"
 
 
@@ -21,37 +24,48 @@
  */
 
 
-// Create and return different CustVector objects, each representing a user, from an input tweet map
+// Create and return different CustVector objects, each representing a user, from the accumulated sentiments of users
+// (posters of tweets, or clusters of tweet vectors), in the order they were added
 template <typename dim_type>
-std::vector< CustVector<dim_type> > tweets_to_user_vectors(std::unordered_map<std::string, Tweet>& tweets, int crypto_num);
-
-// Create and return different CustVector objects, each representing a user, from an input vectors that have been clustered
-template <typename dim_type>
-std::vector< CustVector<dim_type> > clusters_to_user_vectors(std::unordered_map<std::string, Tweet>& tweets,
-        std::vector< CustVector<dim_type> >& vectors, int crypto_num, int user_num);
+std::vector< CustVector<dim_type> > sentiments_to_user_vectors(UserSentiments& sentiments);
 
 // Returns a vector parallel to the input neighbors vector that contains the cosine similarity of each user pair
-// The neighbors vector is sorted and filtered in this function
+// The neighbors vector is filtered to the P most similar ones in this function, sorted by decreasing similarity
 template <typename dim_type>
 std::vector<double> get_P_closest(std::vector< CustVector<dim_type>* >& neighbors, CustVector<dim_type>& user, int P);
 
-// Parralel quicksort implementation
-template <typename dim_type, typename type>
-void parallel_quickSort(std::vector<dim_type>& sim, std::vector< type >& neighbors, int low, int high);
+// Keep only the top_num highest scores of two parallel vectors (eg. similarities and neighbors), with their items,
+// sorted by decreasing score
+// Selected with a bounded heap of the best top_num pairs so far, so it takes O(n log top_num) time, equal scores keep
+// their input order and NaN scores come last
+template <typename score_type, typename item_type>
+void select_top(std::vector<score_type>& scores, std::vector<item_type>& items, int top_num);
 
-// Parallel partition implementation, to be used in parallel quicksort for cosine similarities and neighbors
-template <typename dim_type, typename type>
-int parralel_partition(std::vector<dim_type>& sim, std::vector< type >& neighbors, int low, int high);
+// Scores of the neighbors with the known mean of each one subtracted, row by row (neighbor number x dimensions)
+// Computed once for a batch of users that share their neighbors
+template <typename dim_type>
+std::vector<double> get_centered_scores(const std::vector< CustVector<dim_type>* >& neighbors);
 
 // For a user, calculate and return his predicted scores for unknown cryptocurrencies
 template <typename dim_type>
 std::vector<dim_type> get_predicted_user_sim(std::vector< CustVector<dim_type>* >& neighbors, CustVector<dim_type>& user,
-        std::vector<double> similarities);
+        const std::vector<double>& similarities);
+
+// Same as above, for neighbors that are rows of centered scores (see get_centered_scores), parallel to the similarities
+// The predictions of all unknown cryptocurrencies come from one product of the similarities with those rows
+template <typename dim_type>
+std::vector<dim_type> get_predicted_user_sim(const std::vector<double>& centered_scores, const std::vector<int>& rows,
+        CustVector<dim_type>& user, const std::vector<double>& similarities);
 
 // Return predicted top N (highest scoring) cryptocurrency indexes for an input user
 template <typename dim_type>
 std::vector<int> get_top_N_recom(std::vector< CustVector<dim_type>* >& neighbors, CustVector<dim_type>& user, int N,
-        std::vector<double> similarities);
+        const std::vector<double>& similarities);
+
+// Same as above, for neighbors that are rows of centered scores
+template <typename dim_type>
+std::vector<int> get_top_N_recom(const std::vector<double>& centered_scores, const std::vector<int>& rows,
+        CustVector<dim_type>& user, int N, const std::vector<double>& similarities);
 
 // Return predicted top N (highest scoring) cryptocurrency indexes for an input user
 template <typename dim_type>
@@ -59,7 +73,8 @@ std::vector<int> get_top_N_recom(std::vector< CustVector<dim_type>* >& neighbors
 
 // Split vector of Custom vector into 10 vectors, used for 10-fold cross validation
 template <typename dim_type>
-std::vector< std::vector< CustVector<dim_type> > > split_to_10(std::vector< CustVector<dim_type> > input_vectors);
+std::vector< std::vector< CustVector<dim_type> > > split_to_10(std::vector< CustVector<dim_type> > input_vectors,
+        unsigned long seed);
 
 // Merge input vectors into a vector of Custom vectors except for one, used for 10-fold cross validation
 template <typename dim_type>
@@ -67,8 +82,9 @@ std::vector< CustVector<dim_type> > merge_except_for(std::vector< std::vector< C
         int not_merge_index);
 
 // Alter input Custom vector so that one random score is hidden (returned by the function)
+// The hidden score is drawn from rand_generator, so one generator can be used for all the vectors of a validation
 template <typename dim_type>
-bool hide_one_score(CustVector<dim_type>& inVector, double* old_score);
+bool hide_one_score(CustVector<dim_type>& inVector, double* old_score, std::default_random_engine& rand_generator);
 
 /*
 * Template utility function definitions
@@ -76,120 +92,29 @@ bool hide_one_score(CustVector<dim_type>& inVector, double* old_score);
 
 
 template <typename dim_type>
-std::vector< CustVector<dim_type> > tweets_to_user_vectors(std::unordered_map<std::string, Tweet>& tweets, int crypto_num) {
-    std::unordered_map< std::string, std::vector<dim_type> > user_map;
-    std::unordered_map< std::string, std::vector<int> > known_index_map;
-
-    // For each tweet,
-    for (auto& tweet : tweets) {
-        std::string user_id = tweet.second.getUserId();
-        std::vector<int> crypto_indexes = tweet.second.getCryptoIndexes();
-        double score = tweet.second.getSentimentScore();
-
-        if (user_map.count(user_id) == 0) {
-            std::vector<dim_type> user_vector(crypto_num);
-            user_map.emplace(user_id, user_vector);
-
-            std::vector<int> is_unknown(crypto_num);
-            known_index_map.emplace(user_id, is_unknown);
-        }
-
-        for (auto index : crypto_indexes) {
-            if (score > 0)
-                user_map[user_id][index] = user_map[user_id][index] + score;
-
-            known_index_map[user_id][index] = 1;
-        }
-    }
+std::vector< CustVector<dim_type> > sentiments_to_user_vectors(UserSentiments& sentiments) {
+    int crypto_num = sentiments.getCryptoNumber();
 
     // Create CustVector objects to represent each user
     std::vector< CustVector<dim_type> > user_vectors;
-    for (auto& user : user_map) {
+    for (int user_i = 0; user_i < sentiments.getUserNumber(); user_i++) {
         // Create set of unknown cryptocurrency indexes and calculate vector mean
-        double sum = 0;
-        int known_number = 0;
-        std::set<int> unknown_indexes;
-        bool useless = true;
-        for (int i = 0; i < user.second.size(); i++) {
-            if (known_index_map[user.first][i] == 0) {
-                unknown_indexes.emplace(i);
-            }
-            else {
-                sum = sum + user.second[i];
-                known_number++;
-            }
-
-            if (user.second[i] != 0)
-                useless = false;
-        }
-
-        // Filter vectors that we know nothing of
-        if (!useless) {
-            double mean = sum / known_number;
-
-            // Replace unknown cryptocurrency scores with mean
-            for (int index : unknown_indexes)
-                user.second[index] = mean;
-
-            CustVector<dim_type> current_user(user.first, user.second, unknown_indexes, mean);
-            user_vectors.emplace_back(current_user);
-        }
-    }
-
-    return user_vectors;
-}
-
-
-template <typename dim_type>
-std::vector< CustVector<dim_type> > clusters_to_user_vectors(std::unordered_map<std::string, Tweet>& tweets,
-        std::vector< CustVector<dim_type> >& vectors, int crypto_num, int user_num) {
-
-    // For intermediate calculations
-    std::vector< std::vector<dim_type> > inter_vectors(user_num);
-    std::vector< std::vector<int> > known_indexes(user_num);
-    for (int i = 0; i < user_num; i++) {
         std::vector<dim_type> user_vector(crypto_num);
-        inter_vectors[i] = user_vector;
-
-        std::vector<int> is_unknown(crypto_num);
-        known_indexes[i] = is_unknown;
-    }
-
-    for (auto& vec : vectors) {
-        if (tweets.count(vec.getId()) > 0) {
-            std::string tweet_id = vec.getId();
-            Tweet currTweet = tweets.at(tweet_id);
-
-            std::vector<int> crypto_indexes = currTweet.getCryptoIndexes();
-            double score = currTweet.getSentimentScore();
-
-            for (auto index : crypto_indexes) {
-                if (score > 0)
-                    inter_vectors[vec.getCluster()][index] = inter_vectors[vec.getCluster()][index] + score;
-
-                known_indexes[vec.getCluster()][index] = 1;
-            }
-        }
-    }
-
-    // Create CustVector objects to represent each user
-    std::vector< CustVector<dim_type> > user_vectors;
-    for (int user_index = 0; user_index < inter_vectors.size(); user_index++) {
-        // Create set of unknown cryptocurrency indexes and calculate vector mean
         double sum = 0;
         int known_number = 0;
         std::set<int> unknown_indexes;
         bool useless = true;
-        for (int i = 0; i < inter_vectors[user_index].size(); i++) {
-            if (known_indexes[user_index][i] == 0) {
+        for (int i = 0; i < crypto_num; i++) {
+            user_vector[i] = sentiments.getScore(user_i, i);
+            if (!sentiments.isMentioned(user_i, i)) {
                 unknown_indexes.emplace(i);
             }
             else {
-                sum = sum + inter_vectors[user_index][i];
+                sum = sum + user_vector[i];
                 known_number++;
             }
 
-            if (inter_vectors[user_index][i] != 0)
+            if (user_vector[i] != 0)
                 useless = false;
         }
 
@@ -199,9 +124,9 @@ std::vector< CustVector<dim_type> > clusters_to_user_vectors(std::unordered_map<
 
             // Replace unknown cryptocurrency scores with mean
             for (int index : unknown_indexes)
-                inter_vectors[user_index][index] = mean;
+                user_vector[index] = mean;
 
-            CustVector<dim_type> current_user(std::to_string(user_index), inter_vectors[user_index], unknown_indexes, mean);
+            CustVector<dim_type> current_user(sentiments.getUserId(user_i), user_vector, unknown_indexes, mean);
             user_vectors.emplace_back(current_user);
         }
     }
@@ -219,84 +144,112 @@ std::vector<double> get_P_closest(std::vector< CustVector<dim_type>* >& neighbor
     for (int i = 0; i < neighbors.size(); i++)
         similarities[i] = neighbors[i]->cosineSimilarity(&user);
 
-    // Parallel quicksort algorithm for the two vectors (neighbors and similarities
-    parallel_quickSort(similarities, neighbors, 0, similarities.size()-1);
-
-    if (neighbors.size() > P) {
-        neighbors.resize(P);
-        similarities.resize(P);
-    }
+    // Keep the P most similar neighbors, together with their similarities
+    select_top(similarities, neighbors, P);
 
     return similarities;
 }
 
 
-template <typename dim_type, typename type>
-int parralel_partition(std::vector<dim_type>& sim, std::vector< type >& neighbors, int low, int high) {
-    double pivot = sim[high];
-    int i = (low - 1);
-
-    for (int j = low; j <= high- 1; j++) {
-        // If current element is greater than or equal to pivot
-        if (sim[j] >= pivot) {
-            i++;
-
-            // Parallel swap
-            dim_type temp_sim = sim[i];
-            sim[i] = sim[j];
-            sim[j] = temp_sim;
+template <typename score_type, typename item_type>
+void select_top(std::vector<score_type>& scores, std::vector<item_type>& items, int top_num) {
+    if (top_num <= 0) {
+        scores.clear();
+        items.clear();
+        return;
+    }
 
-            type temp_neigh = neighbors[i];
-            neighbors[i] = neighbors[j];
-            neighbors[j] = temp_neigh;
+    // A pair is better than another if it has a higher score, or the same score and an earlier position
+    auto better = [&scores](int a, int b) {
+        if (std::isnan(scores[a]) || std::isnan(scores[b]))
+            return !std::isnan(scores[a]) && std::isnan(scores[b]);
+        if (scores[a] != scores[b])
+            return scores[a] > scores[b];
+        return a < b;
+    };
+
+    // Heap of the positions of the best pairs so far, with the worst of them on top
+    std::vector<int> best;
+    best.reserve(std::min<size_t>(top_num, scores.size()));
+    for (int i = 0; i < scores.size(); i++) {
+        if (best.size() < top_num) {
+            best.emplace_back(i);
+            std::push_heap(best.begin(), best.end(), better);
+        }
+        else if (better(i, best.front())) {
+            std::pop_heap(best.begin(), best.end(), better);
+            best.back() = i;
+            std::push_heap(best.begin(), best.end(), better);
         }
     }
+    std::sort_heap(best.begin(), best.end(), better);
+
+    std::vector<score_type> top_scores;
+    std::vector<item_type> top_items;
+    top_scores.reserve(best.size());
+    top_items.reserve(best.size());
+    for (int i : best) {
+        top_scores.emplace_back(scores[i]);
+        top_items.emplace_back(items[i]);
+    }
 
-    dim_type temp_sim = sim[i + 1];
-    sim[i + 1] = sim[high];
-    sim[high] = temp_sim;
-
-    type temp_neigh = neighbors[i + 1];
-    neighbors[i + 1] = neighbors[high];
-    neighbors[high] = temp_neigh;
-
-    return (i + 1);
+    scores.swap(top_scores);
+    items.swap(top_items);
 }
 
 
-// Parralel quicksort implementation
-template <typename dim_type, typename type>
-void parallel_quickSort(std::vector<dim_type>& sim, std::vector< type >& neighbors, int low, int high) {
-    if (low < high) {
-        int pi = parralel_partition(sim, neighbors, low, high);
-
-        // Separately sort elements before partition and after partition
-        parallel_quickSort(sim, neighbors, low, pi - 1);
-        parallel_quickSort(sim, neighbors, pi + 1, high);
+template <typename dim_type>
+std::vector<double> get_centered_scores(const std::vector< CustVector<dim_type>* >& neighbors) {
+    if (neighbors.empty())
+        return std::vector<double>();
+
+    unsigned int dim_num = neighbors[0]->getDimensions()->size();
+    std::vector<double> centered_scores(neighbors.size() * dim_num);
+    for (int i = 0; i < neighbors.size(); i++) {
+        const dim_type* neigh_scores = neighbors[i]->getDimensions()->data();
+        double neigh_mean = neighbors[i]->getKnownMean();
+        double* centered_row = centered_scores.data() + i * dim_num;
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+            centered_row[dim_i] = neigh_scores[dim_i] - neigh_mean;
     }
+
+    return centered_scores;
 }
 
 
 template <typename dim_type>
 std::vector<dim_type> get_predicted_user_sim(std::vector< CustVector<dim_type>* >& neighbors, CustVector<dim_type>& user,
-        std::vector<double> similarities) {
-    std::vector<dim_type> predicted_scores(user.getDimensions()->begin(), user.getDimensions()->end());
-
-    for (int index : user.getUnknownIndexes()) {
-        double main_sum = 0;
-        double abs_sum = 0;
+        const std::vector<double>& similarities) {
+    std::vector<int> rows(neighbors.size());
+    for (int i = 0; i < neighbors.size(); i++)
+        rows[i] = i;
 
-        for (int i = 0; i < neighbors.size(); i++) {
-            double cosine_sim = similarities[i];
-            abs_sum = abs_sum + fabs(cosine_sim);
+    return get_predicted_user_sim(get_centered_scores(neighbors), rows, user, similarities);
+}
 
-            std::vector<dim_type>* neigh_scores = neighbors[i]->getDimensions();
-            double neigh_mean = neighbors[i]->getKnownMean();
 
-            main_sum = main_sum + (cosine_sim * (neigh_scores->at(index) - neigh_mean));
-        }
+template <typename dim_type>
+std::vector<dim_type> get_predicted_user_sim(const std::vector<double>& centered_scores, const std::vector<int>& rows,
+        CustVector<dim_type>& user, const std::vector<double>& similarities) {
+    std::vector<dim_type>& user_scores = *(user.getDimensions());
+    std::vector<dim_type> predicted_scores(user_scores.begin(), user_scores.end());
+    unsigned int dim_num = user_scores.size();
+
+    // Similarity weighted sum of the neighbor rows, for every cryptocurrency at once
+    // Neighbors are added in order, so each sum is the same as summing one cryptocurrency at a time
+    std::vector<double> main_sums(dim_num, 0);
+    double abs_sum = 0;
+    for (int i = 0; i < rows.size(); i++) {
+        double cosine_sim = similarities[i];
+        abs_sum = abs_sum + fabs(cosine_sim);
+
+        const double* centered_row = centered_scores.data() + rows[i] * dim_num;
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+            main_sums[dim_i] = main_sums[dim_i] + cosine_sim * centered_row[dim_i];
+    }
 
-        double predicted_score = main_sum / abs_sum;
+    for (int index : user.getUnknownIndexes()) {
+        double predicted_score = main_sums[index] / abs_sum;
         predicted_score = predicted_score + user.getKnownMean();
 
         predicted_scores[index] = predicted_score;
@@ -308,18 +261,29 @@ std::vector<dim_type> get_predicted_user_sim(std::vector< CustVector<dim_type>*
 
 template <typename dim_type>
 std::vector<int> get_top_N_recom(std::vector< CustVector<dim_type>* >& neighbors, CustVector<dim_type>& user, int N,
-        std::vector<double> similarities) {
+        const std::vector<double>& similarities) {
+    std::vector<int> rows(neighbors.size());
+    for (int i = 0; i < neighbors.size(); i++)
+        rows[i] = i;
+
+    return get_top_N_recom(get_centered_scores(neighbors), rows, user, N, similarities);
+}
 
-    std::vector<dim_type> predicted_scores = get_predicted_user_sim(neighbors, user, similarities);
+
+template <typename dim_type>
+std::vector<int> get_top_N_recom(const std::vector<double>& centered_scores, const std::vector<int>& rows,
+        CustVector<dim_type>& user, int N, const std::vector<double>& similarities) {
+
+    std::vector<dim_type> predicted_scores = get_predicted_user_sim(centered_scores, rows, user, similarities);
     std::vector<int> unknown_indexes = user.getUnknownIndexes();
     std::vector<dim_type> unknown_predicted(unknown_indexes.size());
 
     for (int i = 0; i < unknown_indexes.size(); i++)
         unknown_predicted[i] = predicted_scores[unknown_indexes[i]];
 
-    parallel_quickSort(unknown_predicted, unknown_indexes, 0, unknown_predicted.size()-1);
+    // Keep the N highest predicted scores, or all of them if there are fewer unknown cryptocurrencies
+    select_top(unknown_predicted, unknown_indexes, N);
 
-    unknown_indexes.resize(N);
     return unknown_indexes;
 }
 
@@ -331,23 +295,14 @@ std::vector<int> get_top_N_recom(std::vector< CustVector<dim_type>* >& neighbors
     for (int i = 0; i < neighbors.size(); i++)
         similarities[i] = neighbors[i]->cosineSimilarity(&user);
 
-    std::vector<dim_type> predicted_scores = get_predicted_user_sim(neighbors, user, similarities);
-    std::vector<int> unknown_indexes = user.getUnknownIndexes();
-    std::vector<dim_type> unknown_predicted(unknown_indexes.size());
-
-    for (int i = 0; i < unknown_indexes.size(); i++)
-        unknown_predicted[i] = predicted_scores[unknown_indexes[i]];
-
-    parallel_quickSort(unknown_predicted, unknown_indexes, 0, unknown_predicted.size()-1);
-
-    unknown_indexes.resize(N);
-    return unknown_indexes;
+    return get_top_N_recom(neighbors, user, N, similarities);
 }
 
 
 template <typename dim_type>
-std::vector< std::vector< CustVector<dim_type> > > split_to_10(std::vector< CustVector<dim_type> > input_vectors) {
-    srand((int)time(0));
+std::vector< std::vector< CustVector<dim_type> > > split_to_10(std::vector< CustVector<dim_type> > input_vectors,
+        unsigned long seed) {
+    std::default_random_engine rand_generator(seed);
     int each_vector_size = input_vectors.size() / 10;
 
     std::vector< std::vector< CustVector<dim_type> > > split_vectors;
@@ -355,7 +310,8 @@ std::vector< std::vector< CustVector<dim_type> > > split_to_10(std::vector< Cust
         std::vector< CustVector<dim_type> > curr_split;
         curr_split.reserve(each_vector_size);
         for (int curr_size = 0; curr_size < each_vector_size && input_vectors.size() > 0; curr_size++) {
-            int rand_i = rand() % input_vectors.size();
+            std::uniform_int_distribution<int> uni_int_dist(0, input_vectors.size()-1);
+            int rand_i = uni_int_dist(rand_generator);
 
             curr_split.emplace_back(input_vectors[rand_i]);
             input_vectors.erase(input_vectors.begin() + rand_i);
@@ -391,7 +347,7 @@ std::vector< CustVector<dim_type> > merge_except_for(std::vector< std::vector< C
 
 
 template <typename dim_type>
-bool hide_one_score(CustVector<dim_type>& inVector, double* old_score) {
+bool hide_one_score(CustVector<dim_type>& inVector, double* old_score, std::default_random_engine& rand_generator) {
     // Find random index to hide
     std::vector<dim_type>& in_dimensions = *(inVector.getDimensions());
 
@@ -407,13 +363,14 @@ bool hide_one_score(CustVector<dim_type>& inVector, double* old_score) {
 
 
     // Get random index and save the old score to be hidden
-    srand((int)time(0));
-    int hide_index = rand() % known_indexes.size();
+    std::uniform_int_distribution<int> uni_int_dist(0, known_indexes.size()-1);
+    int hide_index = uni_int_dist(rand_generator);
     *old_score = in_dimensions[hide_index];
 
     // Now "known" cryptocurrencies will have the value of 0
     for (int i : inVector.getUnknownIndexes())
         in_dimensions[i] = 0;
+    inVector.updateNorm();
 
     // Calculate new mean
     double new_mean = 0;
@@ -435,6 +392,7 @@ bool hide_one_score(CustVector<dim_type>& inVector, double* old_score) {
     // Make the unknown score's value equal to the new means
     new_mean = new_mean / known_num;
     in_dimensions[hide_index] = new_mean;
+    inVector.updateNorm();
 
     //for (int i : inVector.getUnknownIndexes()) {
     //    new_dims[i] = new_means;
@@ -0,0 +1,237 @@
+#ifndef LIB_BUCKET_VIEW_H
+#define LIB_BUCKET_VIEW_H
+
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+#include "cust_vector.hpp"
+
+/*
+ * Bucket Views
+ *
+ * Read only views over the vectors of a CustHashtable bucket, that point straight into the compressed bucket arrays
+ * of the hashtable, so looking up a bucket copies nothing
+ *
+ * BucketView iterates over all vectors of a bucket
+ * FilteredBucketView only visits the vectors whose detailed hash is the same as the detailed hash of the query vector,
+ * checking each one while iterating, so a filtered bucket is never materialized
+ * Detailed hashes are compared by their fingerprints first, so a vector that does not match almost always costs a
+ * single integer comparison
+ *
+ * A filtered view holds the detailed hash of its query itself, so any number of threads can look up the same hashtable
+ * at once, and views are only valid while their hashtable exists and its buckets are not rebuilt
+ *
+ * Templated, so that it can view any type of vector (int, float type dimensions)
+ */
+
+
+template <typename dim_type>
+class BucketView {
+private:
+    const uint32_t* slots_begin;
+    const uint32_t* slots_end;
+    // Vectors of the hashtable, indexed by slot
+    CustVector<dim_type>* const* slot_vectors;
+
+public:
+    class Iterator {
+    private:
+        const uint32_t* slot;
+        CustVector<dim_type>* const* slot_vectors;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CustVector<dim_type>* value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef CustVector<dim_type>* const* pointer;
+        typedef CustVector<dim_type>* reference;
+
+        Iterator(const uint32_t* in_slot, CustVector<dim_type>* const* in_slot_vectors)
+                : slot(in_slot), slot_vectors(in_slot_vectors) {}
+
+        CustVector<dim_type>* operator*() const { return slot_vectors[*slot]; }
+        // Slot of the current vector in its hashtable
+        uint32_t getSlot() const { return *slot; }
+        Iterator& operator++() { slot++; return *this; }
+        bool operator==(const Iterator& other) const { return slot == other.slot; }
+        bool operator!=(const Iterator& other) const { return slot != other.slot; }
+    };
+
+    BucketView(const uint32_t* in_slots_begin, const uint32_t* in_slots_end,
+               CustVector<dim_type>* const* in_slot_vectors);
+
+    Iterator begin() const;
+    Iterator end() const;
+    CustVector<dim_type>* operator[](unsigned int i) const;
+    unsigned int size() const;
+    bool empty() const;
+};
+
+
+template <typename dim_type>
+class FilteredBucketView {
+private:
+    const uint32_t* slots_begin;
+    const uint32_t* slots_end;
+    CustVector<dim_type>* const* slot_vectors;
+
+    // Detailed hashes of the hashtable by slot, and the one of the query, nothing is filtered without detailed hashes
+    const uint64_t* slot_fingerprints;
+    const int* slot_det_hashes;
+    unsigned int det_hash_num;
+    uint64_t query_fingerprint;
+
+    // Detailed hashes of up to INLINE_DET_HASH_NUM values are kept in the view itself, so a lookup allocates nothing
+    static const unsigned int INLINE_DET_HASH_NUM = 16;
+    int inline_det_hash[INLINE_DET_HASH_NUM];
+    std::vector<int> heap_det_hash;
+
+    const int* queryDetHash() const;
+
+public:
+    class Iterator {
+    private:
+        const FilteredBucketView* view;
+        const uint32_t* slot;
+
+        // Move forward to the first vector, starting from the current one, with the same detailed hash as the query
+        void skipFiltered() {
+            while (slot != view->slots_end && !view->matches(*slot))
+                slot++;
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CustVector<dim_type>* value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef CustVector<dim_type>* const* pointer;
+        typedef CustVector<dim_type>* reference;
+
+        Iterator(const FilteredBucketView* in_view, const uint32_t* in_slot) : view(in_view), slot(in_slot) {
+            skipFiltered();
+        }
+
+        CustVector<dim_type>* operator*() const { return view->slot_vectors[*slot]; }
+        uint32_t getSlot() const { return *slot; }
+        Iterator& operator++() { slot++; skipFiltered(); return *this; }
+        bool operator==(const Iterator& other) const { return slot == other.slot; }
+        bool operator!=(const Iterator& other) const { return slot != other.slot; }
+    };
+
+    FilteredBucketView(const uint32_t* in_slots_begin, const uint32_t* in_slots_end,
+                       CustVector<dim_type>* const* in_slot_vectors,
+                       const uint64_t* in_slot_fingerprints, const int* in_slot_det_hashes,
+                       unsigned int in_det_hash_num);
+
+    // Buffer that the detailed hash of the query is written into, followed by its fingerprint and the slots of its bucket
+    int* getQueryDetHash();
+    void setQueryFingerprint(uint64_t in_query_fingerprint);
+    void setSlots(const uint32_t* in_slots_begin, const uint32_t* in_slots_end);
+
+    // Whether the vector of a slot passes the filter
+    bool matches(uint32_t slot_i) const;
+
+    Iterator begin() const;
+    Iterator end() const;
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+BucketView<dim_type>::BucketView(const uint32_t* in_slots_begin, const uint32_t* in_slots_end,
+                                 CustVector<dim_type>* const* in_slot_vectors)
+        : slots_begin(in_slots_begin), slots_end(in_slots_end), slot_vectors(in_slot_vectors) {}
+
+
+template <typename dim_type>
+typename BucketView<dim_type>::Iterator BucketView<dim_type>::begin() const {
+    return Iterator(slots_begin, slot_vectors);
+}
+
+
+template <typename dim_type>
+typename BucketView<dim_type>::Iterator BucketView<dim_type>::end() const {
+    return Iterator(slots_end, slot_vectors);
+}
+
+
+template <typename dim_type>
+CustVector<dim_type>* BucketView<dim_type>::operator[](unsigned int i) const { return slot_vectors[ slots_begin[i] ]; }
+
+
+template <typename dim_type>
+unsigned int BucketView<dim_type>::size() const { return slots_end - slots_begin; }
+
+
+template <typename dim_type>
+bool BucketView<dim_type>::empty() const { return slots_end == slots_begin; }
+
+
+template <typename dim_type>
+FilteredBucketView<dim_type>::FilteredBucketView(const uint32_t* in_slots_begin, const uint32_t* in_slots_end,
+        CustVector<dim_type>* const* in_slot_vectors,
+        const uint64_t* in_slot_fingerprints, const int* in_slot_det_hashes, unsigned int in_det_hash_num)
+        : slots_begin(in_slots_begin), slots_end(in_slots_end), slot_vectors(in_slot_vectors),
+          slot_fingerprints(in_slot_fingerprints), slot_det_hashes(in_slot_det_hashes), det_hash_num(in_det_hash_num),
+          query_fingerprint(0) {
+    if (det_hash_num > INLINE_DET_HASH_NUM)
+        heap_det_hash.resize(det_hash_num);
+}
+
+
+template <typename dim_type>
+const int* FilteredBucketView<dim_type>::queryDetHash() const {
+    return (det_hash_num > INLINE_DET_HASH_NUM) ? heap_det_hash.data() : inline_det_hash;
+}
+
+
+template <typename dim_type>
+int* FilteredBucketView<dim_type>::getQueryDetHash() {
+    return (det_hash_num > INLINE_DET_HASH_NUM) ? heap_det_hash.data() : inline_det_hash;
+}
+
+
+template <typename dim_type>
+void FilteredBucketView<dim_type>::setQueryFingerprint(uint64_t in_query_fingerprint) {
+    query_fingerprint = in_query_fingerprint;
+}
+
+
+template <typename dim_type>
+void FilteredBucketView<dim_type>::setSlots(const uint32_t* in_slots_begin, const uint32_t* in_slots_end) {
+    slots_begin = in_slots_begin;
+    slots_end = in_slots_end;
+}
+
+
+template <typename dim_type>
+bool FilteredBucketView<dim_type>::matches(uint32_t slot_i) const {
+    if (det_hash_num == 0)
+        return true;
+    if (slot_fingerprints[slot_i] != query_fingerprint)
+        return false;
+
+    // Same fingerprint, make sure that the detailed hashes are actually the same
+    const int* slot_det_hash = slot_det_hashes + (unsigned long) slot_i * det_hash_num;
+    return std::equal(slot_det_hash, slot_det_hash + det_hash_num, queryDetHash());
+}
+
+
+template <typename dim_type>
+typename FilteredBucketView<dim_type>::Iterator FilteredBucketView<dim_type>::begin() const {
+    return Iterator(this, slots_begin);
+}
+
+
+template <typename dim_type>
+typename FilteredBucketView<dim_type>::Iterator FilteredBucketView<dim_type>::end() const {
+    return Iterator(this, slots_end);
+}
+
+
+#endif //LIB_BUCKET_VIEW_H
@@ -0,0 +1,50 @@
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "candidate_set.h"
+
+using namespace std;
+
+CandidateSet::CandidateSet(unsigned int index_num, unsigned int in_max_candidates) : visit_epochs(index_num, 0),
+        epoch(1), max_candidates(in_max_candidates), query_num(0), capped_num(0) {}
+
+
+void CandidateSet::clear() {
+    candidates.clear();
+    query_num++;
+    epoch++;
+
+    // After about four billion queries the epoch wraps around, old stamps could then match again
+    if (epoch == 0) {
+        fill(visit_epochs.begin(), visit_epochs.end(), 0);
+        epoch = 1;
+    }
+}
+
+
+const vector<uint32_t>& CandidateSet::getCandidates() const { return candidates; }
+
+
+unsigned int CandidateSet::getCandidateNumber() const { return candidates.size(); }
+
+
+unsigned int CandidateSet::getIndexNumber() const { return visit_epochs.size(); }
+
+
+unsigned int CandidateSet::getMaxCandidates() const { return max_candidates; }
+
+
+unsigned long CandidateSet::getQueryNumber() const { return query_num; }
+
+
+unsigned long CandidateSet::getCappedNumber() const { return capped_num; }
+
+
+unsigned long CandidateSet::getSize() {
+    unsigned long size = sizeof(*this);
+    size = size + visit_epochs.capacity()*sizeof(uint32_t);
+    size = size + candidates.capacity()*sizeof(uint32_t);
+
+    return size;
+}
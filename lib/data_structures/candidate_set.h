@@ -0,0 +1,81 @@
+#ifndef LIB_CANDIDATE_SET_H
+#define LIB_CANDIDATE_SET_H
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Candidate Set
+ *
+ * Set of the different candidates of a query (eg. the vectors in its LSH buckets), with each candidate identified by a
+ * dense index (its position in the input vector that the hashtables were built from)
+ *
+ * Every index has an epoch stamp, the number of the query that last visited it, so checking and adding a candidate
+ * is a single array access, and starting a new query only increases the epoch instead of clearing the array
+ * The candidates are kept in a flat vector, in the order they were first added
+ *
+ * The number of candidates of a query can be capped, the set is capped as soon as it holds that many and refuses new
+ * candidates, so that the caller can stop collecting them (eg. the classic bound of 3L candidates for L LSH hashtables)
+ * The set counts its queries and how many of them reached the cap
+ *
+ * Not thread safe, every thread needs its own candidate set
+ */
+
+class CandidateSet {
+private:
+    std::vector<uint32_t> visit_epochs;
+    uint32_t epoch;
+
+    std::vector<uint32_t> candidates;
+
+    // Most candidates of a query, 0 for no limit
+    unsigned int max_candidates;
+
+    unsigned long query_num;
+    unsigned long capped_num;
+
+public:
+    CandidateSet(unsigned int index_num, unsigned int in_max_candidates = 0);
+
+    // Start collecting the candidates of a new query
+    void clear();
+    // Add a candidate, return false if it has already been added since the last clear, or the set is full
+    bool insert(uint32_t index);
+
+    // Whether the current query has reached the cap, so collecting more candidates is pointless
+    bool isCapped() const;
+
+    const std::vector<uint32_t>& getCandidates() const;
+    unsigned int getCandidateNumber() const;
+    unsigned int getIndexNumber() const;
+    unsigned int getMaxCandidates() const;
+
+    // Queries since the set was created, and how many of them reached the cap
+    unsigned long getQueryNumber() const;
+    unsigned long getCappedNumber() const;
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+// Defined here, so that it can be inlined in the loops over the buckets
+inline bool CandidateSet::insert(uint32_t index) {
+    if (visit_epochs[index] == epoch)
+        return false;
+
+    if (isCapped())
+        return false;
+
+    visit_epochs[index] = epoch;
+    candidates.emplace_back(index);
+    if (isCapped())
+        capped_num++;
+    return true;
+}
+
+
+inline bool CandidateSet::isCapped() const { return max_candidates != 0 && candidates.size() == max_candidates; }
+
+
+#endif //LIB_CANDIDATE_SET_H
@@ -0,0 +1,104 @@
+#ifndef LIB_CLUSTER_SUMS_H
+#define LIB_CLUSTER_SUMS_H
+
+#include <vector>
+
+/*
+ * Cluster Sums
+ *
+ * Per cluster sum of the dimensions of all member vectors, together with the number of members
+ * It is everything that the k-means update needs to calculate the new centers, so it can be gathered during the
+ * assignment, with each worker thread summing only the vectors that it assigned
+ *
+ * Partial sums of different parts of the input can be merged afterwards
+ *
+ * Templated, so that it can sum any dimension type
+ */
+
+
+template <typename dim_type>
+class ClusterSums {
+private:
+    unsigned int cluster_num;
+    unsigned int dim_num;
+
+    // cluster_num x dim_num sums, one row for each cluster
+    std::vector<dim_type> sums;
+    std::vector<int> member_nums;
+
+public:
+    ClusterSums(unsigned int in_cluster_num, unsigned int in_dim_num);
+
+    // Zero all sums and member counts
+    void reset();
+
+    // Add the dimensions of a vector to the sum of a cluster
+    template <typename in_dim_type>
+    void addVector(int cluster_i, const in_dim_type* in_dimensions);
+
+    // Add the sums and member counts of another object with the same shape to this one
+    void addSums(ClusterSums<dim_type>& other);
+
+    dim_type* getSums(int cluster_i);
+    int getMemberNum(int cluster_i);
+    unsigned int getClusterNumber();
+    unsigned int getDimNumber();
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+ClusterSums<dim_type>::ClusterSums(unsigned int in_cluster_num, unsigned int in_dim_num) :
+        cluster_num(in_cluster_num), dim_num(in_dim_num), sums(in_cluster_num * in_dim_num, 0),
+        member_nums(in_cluster_num, 0) {}
+
+
+template <typename dim_type>
+void ClusterSums<dim_type>::reset() {
+    for (unsigned int i = 0; i < sums.size(); i++)
+        sums[i] = 0;
+    for (unsigned int i = 0; i < member_nums.size(); i++)
+        member_nums[i] = 0;
+}
+
+
+template <typename dim_type>
+template <typename in_dim_type>
+void ClusterSums<dim_type>::addVector(int cluster_i, const in_dim_type* in_dimensions) {
+    dim_type* cluster_sums = &sums[cluster_i * dim_num];
+    for (unsigned int i = 0; i < dim_num; i++)
+        cluster_sums[i] = cluster_sums[i] + in_dimensions[i];
+
+    member_nums[cluster_i]++;
+}
+
+
+template <typename dim_type>
+void ClusterSums<dim_type>::addSums(ClusterSums<dim_type>& other) {
+    for (unsigned int i = 0; i < sums.size(); i++)
+        sums[i] = sums[i] + other.sums[i];
+    for (unsigned int i = 0; i < member_nums.size(); i++)
+        member_nums[i] = member_nums[i] + other.member_nums[i];
+}
+
+
+template <typename dim_type>
+dim_type* ClusterSums<dim_type>::getSums(int cluster_i) { return &sums[cluster_i * dim_num]; }
+
+
+template <typename dim_type>
+int ClusterSums<dim_type>::getMemberNum(int cluster_i) { return member_nums[cluster_i]; }
+
+
+template <typename dim_type>
+unsigned int ClusterSums<dim_type>::getClusterNumber() { return cluster_num; }
+
+
+template <typename dim_type>
+unsigned int ClusterSums<dim_type>::getDimNumber() { return dim_num; }
+
+
+#endif //LIB_CLUSTER_SUMS_H
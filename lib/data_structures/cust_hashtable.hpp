@@ -2,9 +2,14 @@
 #define LIB_CUST_HASHTABLE_H
 
 #include <vector>
+#include <cstdint>
+#include <algorithm>
 
 #include "../generators/hash_generator.hpp"
-#include "../data_structures/vector_bucket.hpp"
+#include "cust_vector.hpp"
+#include "bucket_view.hpp"
+#include "probe_buffer.hpp"
+#include "../parallel/thread_pool.h"
 
 /*
  * Custom Hashtable
@@ -16,6 +21,26 @@
  * Accepts any HashGenerator object as its hash generator, so that it can be used for
  * any metric we want to use
  *
+ * Inserted vectors take consecutive slots, so hashtables filled with the same input vectors in the same
+ * order (eg. the LSH hashtables of create_LSH_hashtables) give each vector the same slot, its index in the input
+ * The buckets are stored in compressed sparse row form,
+ * one array with the slot indexes of all buckets one after the other, and one array with the offset where each
+ * bucket starts in it
+ * The bucket arrays are built all at once by buildBuckets, with a counting pass over the bucket of every slot, so
+ * hashing allocates nothing per bucket and a lookup is a single contiguous range
+ * Lookups see the buckets as of the last buildBuckets, so buildBuckets must be called again after inserting more
+ *
+ * For parallel construction, a block of slots can be added at once and then filled from many threads, each slot
+ * with its own set call, and the buckets can be built with a thread pool, which counts and scatters chunks of the
+ * slots in parallel and gives the same bucket arrays as the serial build
+ *
+ * Lookups are const and only read the hashtable, so many threads can look up the same hashtable at once
+ *
+ * Buckets can be looked up as views that point into these arrays, which copy nothing, or as vectors
+ *
+ * If the hash generator has a detailed hash, the detailed hashes of all slots are kept in one flat array, slot after
+ * slot, with a 64 bit fingerprint of each, so the filtered lookups compare integers instead of looking up vector ids
+ *
  * Templated, so that it can store any type of vector (int, float type dimensions)
  */
 
@@ -24,18 +49,62 @@ template <typename dim_type>
 class CustHashtable {
 private:
     HashGenerator<dim_type>* hashGenerator;
-    std::vector< VectorBucket<dim_type>* > buckets;
+    unsigned int bucket_num;
+
+    // Inserted vectors and the bucket of each one, by slot
+    std::vector< CustVector<dim_type>* > slot_vectors;
+    std::vector<uint32_t> slot_buckets;
+
+    // Compressed sparse row buckets, the slots of bucket i are bucket_slots[bucket_offsets[i]..bucket_offsets[i+1])
+    std::vector<uint32_t> bucket_offsets;
+    std::vector<uint32_t> bucket_slots;
+
+    // Detailed hashes, det_hash_num values for each slot, and their fingerprints
+    unsigned int det_hash_num;
+    std::vector<int> slot_det_hashes;
+    std::vector<uint64_t> slot_fingerprints;
+
+    // Store the detailed hash that the hash generator has just written for the newest slot
+    void addSlotFingerprint();
+    uint64_t fingerprint(const int* det_hash) const;
+    // Hash an already added slot from its inner products, writing its bucket, detailed hash and fingerprint
+    void hashSlot(unsigned int slot_i, const double* inner_products);
 
 public:
-    CustHashtable(HashGenerator<dim_type>* inHashGen, int bucket_num);
-    // Destructor also deletes input hash generator, other than the created buckets
+    CustHashtable(HashGenerator<dim_type>* inHashGen, int in_bucket_num);
+    // Destructor also deletes input hash generator
     ~CustHashtable();
 
     int insertVector(CustVector<dim_type>* inVector);
-    std::vector< CustVector<dim_type>* > getFilteredBucketFor(CustVector<dim_type>* queryVector);
-    std::vector< CustVector<dim_type>* > getBucketFor(CustVector<dim_type>* queryVector);
-    std::vector< CustVector<dim_type>* > getBucketFromIndex(int index);
-    int getHash(CustVector<dim_type>* queryVector);
+    // Add slot_num empty slots for vectors and return the first one
+    // Each slot must then be set once, with the inner products of its vector with the projections of the hash
+    // generator, and different slots can be set from different threads
+    unsigned int addVectorSlots(unsigned int slot_num);
+    void setVectorSlot(unsigned int slot_i, CustVector<dim_type>* inVector, const double* inner_products);
+    // Lay out the buckets as contiguous arrays, after all vectors are inserted
+    void buildBuckets();
+    void buildBuckets(ThreadPool& pool);
+
+    // Views over the bucket of a query vector, or of a bucket index, valid until the buckets are rebuilt
+    // The filtered view only visits the vectors with the same detailed hash as the query vector
+    BucketView<dim_type> viewBucketFor(CustVector<dim_type>* queryVector) const;
+    BucketView<dim_type> viewBucketFromIndex(int index) const;
+    FilteredBucketView<dim_type> viewFilteredBucketFor(CustVector<dim_type>* queryVector) const;
+    // Multi-probe lookup, the filtered views of up to probe_num probes of the query vector, its own bucket first and
+    // then the buckets its neighbors are most likely to be in, written into the views of the probe buffer
+    // Probes with the same bucket and detailed hash as an earlier one are skipped
+    void viewFilteredProbesFor(CustVector<dim_type>* queryVector, unsigned int probe_num,
+                               ProbeBuffer<dim_type>* probes) const;
+
+    std::vector< CustVector<dim_type>* > getFilteredBucketFor(CustVector<dim_type>* queryVector) const;
+    std::vector< CustVector<dim_type>* > getBucketFor(CustVector<dim_type>* queryVector) const;
+    std::vector< CustVector<dim_type>* > getBucketFromIndex(int index) const;
+    int getHash(CustVector<dim_type>* queryVector) const;
+
+    HashGenerator<dim_type>* getHashGenerator() const;
+    unsigned int getBucketNumber() const;
+    unsigned int getSlotNumber() const;
+    CustVector<dim_type>* getSlotVector(uint32_t slot_i) const;
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -48,91 +117,270 @@ public:
 
 
 template <typename dim_type>
-CustHashtable<dim_type>::CustHashtable(HashGenerator<dim_type>* inHashGen, int bucket_num) : hashGenerator(inHashGen) {
-    for (unsigned int i = 0; i < bucket_num; i++)
-        buckets.emplace_back( new VectorBucket<dim_type>() );
+CustHashtable<dim_type>::CustHashtable(HashGenerator<dim_type>* inHashGen, int in_bucket_num)
+        : hashGenerator(inHashGen), bucket_num(in_bucket_num),
+          bucket_offsets(in_bucket_num + 1, 0) {
+    det_hash_num = hashGenerator->hasDetailedHash() ? hashGenerator->getDetailedHashNumber() : 0;
 }
 
 
 template <typename dim_type>
 CustHashtable<dim_type>::~CustHashtable() {
-    for (int i = 0; i < buckets.size(); i++)
-        delete buckets[i];
     delete hashGenerator;
 }
 
 
 template <typename dim_type>
 int CustHashtable<dim_type>::insertVector(CustVector<dim_type>* inVector) {
+    // The generator writes the detailed hash of the vector straight into its slot
+    slot_det_hashes.resize(slot_det_hashes.size() + det_hash_num);
+    int* det_hash = slot_det_hashes.data() + slot_det_hashes.size() - det_hash_num;
+
     // Mod should not matter if the hash as accurate
-    unsigned int index = mod(hashGenerator->generate(inVector), buckets.size());
-    buckets[index]->insertVector(inVector);
+    unsigned int index = mod(hashGenerator->hash(*inVector, det_hash), bucket_num);
+    slot_vectors.emplace_back(inVector);
+    slot_buckets.emplace_back(index);
+    addSlotFingerprint();
+
+    return index;
 }
 
 
 template <typename dim_type>
-std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getFilteredBucketFor(CustVector<dim_type>* queryVector) {
-    // Mod should not matter if the hash as accurate
-    unsigned int index = mod(hashGenerator->generate(queryVector), buckets.size());
-
-    std::vector< CustVector<dim_type>* > tempBucket = *( buckets[index]->getVectors() );
-    std::vector< CustVector<dim_type>* > retBucket;
-
-    if (hashGenerator->hasDetailedHash()) {
-        std::unordered_map<std::string, std::vector<int>>* id_to_hashes = hashGenerator->getDetailedHashes();
-        std::vector<int>* query_det_hash = &( (*id_to_hashes)[ queryVector->getId() ] );
-
-        // Compare the detailed hash of each vector in the bucket with the query vector
-        for (const auto& buckVector : tempBucket) {
-            bool diff = false;
-            for (unsigned int hash_i = 0; hash_i < query_det_hash->size(); hash_i++) {
-                std::vector<int> curr_det_hash = (*id_to_hashes)[ buckVector->getId() ];
-                if ( (curr_det_hash)[hash_i] != (*query_det_hash)[hash_i]) {
-                    diff = true;
-                    break;
-                }
-            }
-            if (!diff)
-                retBucket.emplace_back(buckVector);
+unsigned int CustHashtable<dim_type>::addVectorSlots(unsigned int slot_num) {
+    unsigned int first_slot = slot_buckets.size();
+    slot_vectors.resize(first_slot + slot_num, nullptr);
+    slot_buckets.resize(first_slot + slot_num);
+    slot_det_hashes.resize((first_slot + slot_num) * det_hash_num);
+    if (det_hash_num > 0)
+        slot_fingerprints.resize(first_slot + slot_num);
+
+    return first_slot;
+}
+
+
+template <typename dim_type>
+void CustHashtable<dim_type>::setVectorSlot(unsigned int slot_i, CustVector<dim_type>* inVector,
+                                            const double* inner_products) {
+    slot_vectors[slot_i] = inVector;
+    hashSlot(slot_i, inner_products);
+}
+
+
+template <typename dim_type>
+void CustHashtable<dim_type>::hashSlot(unsigned int slot_i, const double* inner_products) {
+    // The generator writes the detailed hash of the vector straight into its slot
+    int* det_hash = slot_det_hashes.data() + slot_i * det_hash_num;
+
+    slot_buckets[slot_i] = mod(hashGenerator->hashProjections(inner_products, det_hash), bucket_num);
+    if (det_hash_num > 0)
+        slot_fingerprints[slot_i] = fingerprint(det_hash);
+}
+
+
+template <typename dim_type>
+void CustHashtable<dim_type>::buildBuckets() {
+    // Count the slots of each bucket, shifted by one so that the prefix sum gives the start of each bucket
+    for (unsigned int i = 0; i < bucket_offsets.size(); i++)
+        bucket_offsets[i] = 0;
+    for (uint32_t bucket_i : slot_buckets)
+        bucket_offsets[bucket_i + 1]++;
+    for (unsigned int i = 1; i < bucket_offsets.size(); i++)
+        bucket_offsets[i] = bucket_offsets[i] + bucket_offsets[i - 1];
+
+    // Scatter the slots in insertion order, so each bucket keeps the order in which its vectors were inserted
+    std::vector<uint32_t> next_positions(bucket_offsets.begin(), bucket_offsets.end() - 1);
+    bucket_slots.resize(slot_buckets.size());
+    for (uint32_t slot_i = 0; slot_i < slot_buckets.size(); slot_i++)
+        bucket_slots[ next_positions[ slot_buckets[slot_i] ]++ ] = slot_i;
+}
+
+
+template <typename dim_type>
+void CustHashtable<dim_type>::buildBuckets(ThreadPool& pool) {
+    unsigned int chunk_num = pool.getThreadNum();
+    if (chunk_num <= 1 || slot_buckets.size() < chunk_num) {
+        buildBuckets();
+        return;
+    }
+
+    // Count the slots of each bucket in each chunk of slots
+    std::vector<uint32_t> chunk_counts(chunk_num * bucket_num, 0);
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        unsigned int begin, end;
+        get_chunk_bounds(slot_buckets.size(), chunk_num, chunk_i, &begin, &end);
+
+        uint32_t* counts = chunk_counts.data() + chunk_i * bucket_num;
+        for (unsigned int slot_i = begin; slot_i < end; slot_i++)
+            counts[ slot_buckets[slot_i] ]++;
+    });
+
+    // Within a bucket, the slots of the first chunk go first, so the buckets keep the insertion order
+    // The counts are turned into the position where each chunk starts writing in each bucket
+    uint32_t position = 0;
+    for (unsigned int bucket_i = 0; bucket_i < bucket_num; bucket_i++) {
+        bucket_offsets[bucket_i] = position;
+        for (unsigned int chunk_i = 0; chunk_i < chunk_num; chunk_i++) {
+            uint32_t count = chunk_counts[chunk_i * bucket_num + bucket_i];
+            chunk_counts[chunk_i * bucket_num + bucket_i] = position;
+            position = position + count;
         }
     }
-    else
-        retBucket = tempBucket;
+    bucket_offsets[bucket_num] = position;
+
+    bucket_slots.resize(slot_buckets.size());
+    pool.parallelFor(chunk_num, [&](unsigned int chunk_i) {
+        unsigned int begin, end;
+        get_chunk_bounds(slot_buckets.size(), chunk_num, chunk_i, &begin, &end);
+
+        uint32_t* next_positions = chunk_counts.data() + chunk_i * bucket_num;
+        for (uint32_t slot_i = begin; slot_i < end; slot_i++)
+            bucket_slots[ next_positions[ slot_buckets[slot_i] ]++ ] = slot_i;
+    });
+}
+
+
+template <typename dim_type>
+void CustHashtable<dim_type>::addSlotFingerprint() {
+    if (det_hash_num > 0)
+        slot_fingerprints.emplace_back( fingerprint(slot_det_hashes.data() + slot_det_hashes.size() - det_hash_num) );
+}
+
+
+template <typename dim_type>
+uint64_t CustHashtable<dim_type>::fingerprint(const int* det_hash) const {
+    // FNV-1a over the values of the detailed hash
+    uint64_t fingerprint = 14695981039346656037ULL;
+    for (unsigned int i = 0; i < det_hash_num; i++) {
+        fingerprint = fingerprint ^ (uint32_t) det_hash[i];
+        fingerprint = fingerprint * 1099511628211ULL;
+    }
 
-    return retBucket;
+    return fingerprint;
 }
 
 
 template <typename dim_type>
-std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getBucketFor(CustVector<dim_type>* queryVector) {
+BucketView<dim_type> CustHashtable<dim_type>::viewBucketFor(CustVector<dim_type>* queryVector) const {
     // Mod should not matter if the hash is accurate
-    unsigned int index = mod(hashGenerator->generate(queryVector), buckets.size());
-    std::vector< CustVector<dim_type>* > retBucket =*( buckets[index]->getVectors() );
+    unsigned int index = mod(hashGenerator->hash(*queryVector), bucket_num);
 
-    return retBucket;
+    return viewBucketFromIndex(index);
 }
 
 
 template <typename dim_type>
-std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getBucketFromIndex(int index) {
-    return *( buckets[index]->getVectors() );
+BucketView<dim_type> CustHashtable<dim_type>::viewBucketFromIndex(int index) const {
+    return BucketView<dim_type>(bucket_slots.data() + bucket_offsets[index], bucket_slots.data() + bucket_offsets[index + 1],
+                                slot_vectors.data());
 }
 
 
 template <typename dim_type>
-int CustHashtable<dim_type>::getHash(CustVector<dim_type>* queryVector) {
-    return mod(hashGenerator->generate(queryVector), buckets.size());
+FilteredBucketView<dim_type> CustHashtable<dim_type>::viewFilteredBucketFor(CustVector<dim_type>* queryVector) const {
+    FilteredBucketView<dim_type> bucketView(nullptr, nullptr, slot_vectors.data(), slot_fingerprints.data(),
+                                            slot_det_hashes.data(), det_hash_num);
+
+    // The detailed hash of the query is written straight into the view
+    // Mod should not matter if the hash as accurate
+    unsigned int index = mod(hashGenerator->hash(*queryVector, bucketView.getQueryDetHash()), bucket_num);
+    if (det_hash_num > 0)
+        bucketView.setQueryFingerprint( fingerprint(bucketView.getQueryDetHash()) );
+    bucketView.setSlots(bucket_slots.data() + bucket_offsets[index], bucket_slots.data() + bucket_offsets[index + 1]);
+
+    return bucketView;
 }
 
 
+template <typename dim_type>
+void CustHashtable<dim_type>::viewFilteredProbesFor(CustVector<dim_type>* queryVector, unsigned int probe_num,
+                                                    ProbeBuffer<dim_type>* probes) const {
+    probes->fit(hashGenerator->getProjectionNumber(), probe_num, det_hash_num);
+    if (probe_num == 0)
+        return;
+
+    hashGenerator->projectDimensions(queryVector->getDimensions()->data(), probes->getInnerProducts());
+    unsigned int found_num = hashGenerator->hashProbes(probes->getInnerProducts(), probe_num, probes->getProbeHashes(),
+                                                       probes->getProbeDetHashes(), probes->getPerturbations());
+
+    std::vector< std::pair<unsigned int, uint64_t> >& probed = probes->getProbed();
+    std::vector< FilteredBucketView<dim_type> >& views = probes->getViews();
+    for (unsigned int probe_i = 0; probe_i < found_num; probe_i++) {
+        unsigned int index = mod(probes->getProbeHashes()[probe_i], bucket_num);
+        const int* det_hash = probes->getProbeDetHashes() + probe_i * det_hash_num;
+        uint64_t query_fingerprint = (det_hash_num > 0) ? fingerprint(det_hash) : 0;
+
+        std::pair<unsigned int, uint64_t> probe(index, query_fingerprint);
+        if (std::find(probed.begin(), probed.end(), probe) != probed.end())
+            continue;
+        probed.emplace_back(probe);
+
+        FilteredBucketView<dim_type> bucketView(bucket_slots.data() + bucket_offsets[index],
+                                                bucket_slots.data() + bucket_offsets[index + 1], slot_vectors.data(),
+                                                slot_fingerprints.data(), slot_det_hashes.data(), det_hash_num);
+        std::copy(det_hash, det_hash + det_hash_num, bucketView.getQueryDetHash());
+        bucketView.setQueryFingerprint(query_fingerprint);
+        views.emplace_back(bucketView);
+    }
+}
+
+
+template <typename dim_type>
+std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getFilteredBucketFor(CustVector<dim_type>* queryVector) const {
+    FilteredBucketView<dim_type> bucketView = viewFilteredBucketFor(queryVector);
+
+    return std::vector< CustVector<dim_type>* >(bucketView.begin(), bucketView.end());
+}
+
+
+template <typename dim_type>
+std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getBucketFor(CustVector<dim_type>* queryVector) const {
+    BucketView<dim_type> bucketView = viewBucketFor(queryVector);
+
+    return std::vector< CustVector<dim_type>* >(bucketView.begin(), bucketView.end());
+}
+
+
+template <typename dim_type>
+std::vector< CustVector<dim_type>* > CustHashtable<dim_type>::getBucketFromIndex(int index) const {
+    BucketView<dim_type> bucketView = viewBucketFromIndex(index);
+
+    return std::vector< CustVector<dim_type>* >(bucketView.begin(), bucketView.end());
+}
+
+
+template <typename dim_type>
+int CustHashtable<dim_type>::getHash(CustVector<dim_type>* queryVector) const {
+    return mod(hashGenerator->hash(*queryVector), bucket_num);
+}
+
+
+template <typename dim_type>
+HashGenerator<dim_type>* CustHashtable<dim_type>::getHashGenerator() const { return hashGenerator; }
+
+
+template <typename dim_type>
+unsigned int CustHashtable<dim_type>::getBucketNumber() const { return bucket_num; }
+
+
+template <typename dim_type>
+unsigned int CustHashtable<dim_type>::getSlotNumber() const { return slot_buckets.size(); }
+
+
+template <typename dim_type>
+CustVector<dim_type>* CustHashtable<dim_type>::getSlotVector(uint32_t slot_i) const { return slot_vectors[slot_i]; }
+
+
 template <typename dim_type>
 unsigned long CustHashtable<dim_type>::getSize() {
     unsigned long size = sizeof(*this);
     size = size + hashGenerator->getSize();
-    size = size + buckets.capacity()*sizeof(VectorBucket<dim_type>*);
-    for (int i = 0; i < buckets.size(); i++) {
-        size = size + buckets[i]->getSize();
-    }
+    size = size + slot_vectors.capacity()*sizeof(CustVector<dim_type>*);
+    size = size + slot_buckets.capacity()*sizeof(uint32_t);
+    size = size + bucket_offsets.capacity()*sizeof(uint32_t);
+    size = size + bucket_slots.capacity()*sizeof(uint32_t);
+    size = size + slot_det_hashes.capacity()*sizeof(int);
+    size = size + slot_fingerprints.capacity()*sizeof(uint64_t);
 
     return size;
 }
@@ -7,13 +7,16 @@
 #include <cmath>
 #include <set>
 
+#include "../kernels/distance_kernels.hpp"
+
 /*
  * Custom Vector
  *
  * Vector class used to represent vectors in this project
  * Contains its id and dimension values
  *
- * Operations between vectors are also implemented here (inner product, euclidean and cosine distances)
+ * Operations between vectors are also implemented here (inner product, euclidean and cosine distances),
+ * the actual loops over the dimensions are done by the distance kernels
  *
  * Templated, so that it can have any dimension type
  */
@@ -35,6 +38,10 @@ private:
     int cluster_i;
     double dist_from_centroid;
 
+    // L2 norm, recalculated by every operation that alters the dimensions, so that reading it never writes anything
+    // and many threads can use the same vector at once
+    double norm;
+
 public:
     CustVector(std::string in_id, std::vector<dim_type> dim_vector);
     CustVector(std::string in_id, std::vector<dim_type> dim_vector, std::set<int> unknown_indexes, double mean);
@@ -45,6 +52,9 @@ public:
     // Vector operations
     template <typename in_dim_type>
     long double inner_product(CustVector<in_dim_type>* inVector, long double strt);
+    // Inner product with raw dimensions, which must have the same number of dimensions
+    template <typename in_dim_type>
+    long double inner_product(const in_dim_type* in_dimensions, long double strt) const;
     template <typename in_dim_type>
     double euclideanDistance(CustVector<in_dim_type>* inVector);
     template <typename in_dim_type>
@@ -58,14 +68,19 @@ public:
     void setCluster(int index, double dist);
     void resetCluster();
 
+    // Recalculate the norm, must be called after the dimensions are altered through getDimensions()
+    void updateNorm();
+
     void setKnownMean(double in_mean);
     void setUnknownIndexes(std::set<int> in_indexes);
 
-    std::string getId();
+    const std::string& getId();
     std::vector<dim_type>* getDimensions();
+    const std::vector<dim_type>* getDimensions() const;
     std::vector<int> getUnknownIndexes();
     std::set<int> getUnknownIndexesSet();
     double getKnownMean();
+    double getNorm() const;
     unsigned int getDimNumber();
     int getCluster();
     double getDistFromCentroid();
@@ -79,16 +94,23 @@ public:
 
 template <typename dim_type>
 CustVector<dim_type>::CustVector(std::string in_id, std::vector<dim_type> dim_vector)
-        : id(std::move(in_id)), dimensions(dim_vector), cluster_i(-1), dist_from_centroid(0), known_mean(0) {};
+        : id(std::move(in_id)), dimensions(dim_vector), cluster_i(-1), dist_from_centroid(0), known_mean(0), norm(0) {
+    updateNorm();
+}
 
 template <typename dim_type>
 CustVector<dim_type>::CustVector(std::string in_id, std::vector<dim_type> dim_vector, std::set<int> indexes, double mean)
         : id(std::move(in_id)), dimensions(dim_vector), cluster_i(-1), dist_from_centroid(0), unknown_indexes(
-        std::move(indexes)), known_mean(mean) {};
+        std::move(indexes)), known_mean(mean), norm(0) {
+    updateNorm();
+}
 
 template <typename dim_type>
 CustVector<dim_type>::CustVector(std::string in_id, std::vector<dim_type> dim_vector, int cluster, double distance)
-        : id(std::move(in_id)), dimensions(dim_vector), cluster_i(cluster), dist_from_centroid(distance), known_mean(0) {};
+        : id(std::move(in_id)), dimensions(dim_vector), cluster_i(cluster), dist_from_centroid(distance), known_mean(0),
+        norm(0) {
+    updateNorm();
+}
 
 // Copy constructor
 template <typename dim_type>
@@ -99,13 +121,13 @@ CustVector<dim_type>::CustVector(const CustVector &cust2) {
     known_mean = cust2.known_mean;
     cluster_i = cust2.cluster_i;
     dist_from_centroid = cust2.dist_from_centroid;
+    norm = cust2.norm;
 }
 
 
 template <typename dim_type>
 template <typename in_dim_type>
 long double CustVector<dim_type>::inner_product(CustVector<in_dim_type>* inVector, long double strt) {
-    long double accum = strt;
     std::vector<in_dim_type>* in_dimensions = inVector->getDimensions();
 
     if (dimensions.size() != in_dimensions->size()) {
@@ -114,73 +136,55 @@ long double CustVector<dim_type>::inner_product(CustVector<in_dim_type>* inVecto
         return -1;
     }
 
-    for (unsigned int i = 0; i < dimensions.size(); i++)
-        accum = accum + ( dimensions[i] * (*in_dimensions)[i] );
+    return inner_product<in_dim_type>(in_dimensions->data(), strt);
+}
 
-    return accum;
+
+template <typename dim_type>
+template <typename in_dim_type>
+long double CustVector<dim_type>::inner_product(const in_dim_type* in_dimensions, long double strt) const {
+    return strt + dot_kernel(dimensions.data(), in_dimensions, dimensions.size());
 }
 
 
 template <typename dim_type>
 template <typename in_dim_type>
 double CustVector<dim_type>::euclideanDistance(CustVector<in_dim_type>* inVector) {
-    double dist = 0;
-    double accum = 0;
     std::vector<in_dim_type>* in_dimensions = inVector->getDimensions();
 
-    for (unsigned int i = 0; i < dimensions.size(); i++)
-        accum = accum + pow( (dimensions[i] - (*in_dimensions)[i]) , 2);
-
-    dist = sqrt(accum);
-    return dist;
+    return sqrt( squared_l2_kernel(dimensions.data(), in_dimensions->data(), dimensions.size()) );
 }
 
 
 template <typename dim_type>
 template <typename in_dim_type>
 double CustVector<dim_type>::cosineDistance(CustVector<in_dim_type>* inVector) {
-    long double inner_product = this->template inner_product<in_dim_type>(inVector, 0.0);
-
-    // Calculate denominators
-    std::vector<in_dim_type>* in_dimensions = inVector->getDimensions();
-    double accum = 0;
-    double in_accum = 0;
-    for (unsigned int i = 0; i < dimensions.size(); i++) {
-        accum = accum + pow(dimensions[i], 2);
-        in_accum = in_accum + pow((*in_dimensions)[i], 2);
-    }
-    double denom = sqrt(accum) * sqrt(in_accum);
-
-    return 1 - double( inner_product / denom );
+    return 1 - cosineSimilarity<in_dim_type>(inVector);
 }
 
 
 template <typename dim_type>
 template <typename in_dim_type>
 double CustVector<dim_type>::cosineSimilarity(CustVector<in_dim_type>* inVector) {
-    long double inner_product = this->template inner_product<in_dim_type>(inVector, 0.0);
-
-    // Calculate denominators
     std::vector<in_dim_type>* in_dimensions = inVector->getDimensions();
-    double accum = 0;
-    double in_accum = 0;
-    for (unsigned int i = 0; i < dimensions.size(); i++) {
-        accum = accum + pow(dimensions[i], 2);
-        in_accum = in_accum + pow((*in_dimensions)[i], 2);
-    }
-    double denom = sqrt(accum) * sqrt(in_accum);
 
-    return double( inner_product / denom );
+    // Norms are cached, so only the inner product is calculated here
+    double inner_prod = dot_kernel(dimensions.data(), in_dimensions->data(), dimensions.size());
+    double denom = getNorm() * inVector->getNorm();
+
+    return inner_prod / denom;
 }
 
 
 template <typename dim_type>
 template <typename in_dim_type>
 void CustVector<dim_type>::addVectorToThis(CustVector<in_dim_type>* inVector) {
-    std::vector<in_dim_type> in_dimensions = *(inVector->getDimensions());
+    std::vector<in_dim_type>& in_dimensions = *(inVector->getDimensions());
 
     for (int i = 0; i < dimensions.size(); i++)
         dimensions[i] = dimensions[i] + in_dimensions[i];
+
+    updateNorm();
 }
 
 
@@ -189,6 +193,8 @@ void CustVector<dim_type>::divDimensionsByD(double div_const) {
     if (div_const != 0) {
         for (int i = 0; i < dimensions.size(); i++)
             dimensions[i] = dimensions[i] / div_const;
+
+        updateNorm();
     }
 
 }
@@ -207,6 +213,11 @@ void CustVector<dim_type>::resetCluster() {
     dist_from_centroid = 0;
 }
 
+template <typename dim_type>
+void CustVector<dim_type>::updateNorm() {
+    norm = sqrt( dot_kernel(dimensions.data(), dimensions.data(), dimensions.size()) );
+}
+
 template <typename dim_type>
 void CustVector<dim_type>::setKnownMean(double in_mean) {
     known_mean = in_mean;
@@ -218,13 +229,17 @@ void CustVector<dim_type>::setUnknownIndexes(std::set<int> in_indexes) {
 }
 
 template <typename dim_type>
-std::string CustVector<dim_type>::getId() { return id; }
+const std::string& CustVector<dim_type>::getId() { return id; }
 
 
 template <typename dim_type>
 std::vector<dim_type>* CustVector<dim_type>::getDimensions() { return &dimensions; }
 
 
+template <typename dim_type>
+const std::vector<dim_type>* CustVector<dim_type>::getDimensions() const { return &dimensions; }
+
+
 template <typename dim_type>
 std::vector<int> CustVector<dim_type>::getUnknownIndexes() {
     std::vector<int> indexes_vector(unknown_indexes.begin(), unknown_indexes.end());
@@ -239,6 +254,10 @@ template <typename dim_type>
 double CustVector<dim_type>::getKnownMean() { return known_mean; }
 
 
+template <typename dim_type>
+double CustVector<dim_type>::getNorm() const { return norm; }
+
+
 template <typename dim_type>
 unsigned int CustVector<dim_type>::getDimNumber() { return dimensions.size(); }
 
@@ -0,0 +1,133 @@
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+#include "distance_cache.h"
+
+using namespace std;
+
+// Key of empty hashtable slots, no pair packs to it as long as indexes are lower than the largest 32 bit value
+static const uint64_t EMPTY_KEY = numeric_limits<uint64_t>::max();
+static const unsigned long INITIAL_CAPACITY = 1024;
+
+DistanceCache::DistanceCache(unsigned int in_index_num, unsigned long memory_budget) : index_num(in_index_num),
+        pair_num(0), hit_num(0), miss_num(0) {
+    unsigned long triangle_size = (unsigned long) index_num * (index_num + 1) / 2;
+    triangular = triangle_size * sizeof(double) <= memory_budget;
+
+    if (triangular)
+        matrix.resize(triangle_size, numeric_limits<double>::quiet_NaN());
+    else {
+        keys.resize(INITIAL_CAPACITY, EMPTY_KEY);
+        values.resize(INITIAL_CAPACITY);
+    }
+}
+
+
+unsigned long DistanceCache::matrixIndex(unsigned int i, unsigned int j) {
+    if (i < j) {
+        unsigned int temp = i;
+        i = j;
+        j = temp;
+    }
+
+    return (unsigned long) i * (i + 1) / 2 + j;
+}
+
+
+uint64_t DistanceCache::pairKey(unsigned int i, unsigned int j) {
+    if (i > j)
+        return ((uint64_t) j << 32) | i;
+    return ((uint64_t) i << 32) | j;
+}
+
+
+unsigned long DistanceCache::findSlot(uint64_t key) {
+    // Mix the key bits, so that close indexes do not end up in neighboring slots
+    uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+    hash = hash ^ (hash >> 32);
+
+    unsigned long mask = keys.size() - 1;
+    unsigned long slot = hash & mask;
+    while (keys[slot] != EMPTY_KEY && keys[slot] != key)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+
+void DistanceCache::growHashtable() {
+    vector<uint64_t> old_keys(keys.size() * 2, EMPTY_KEY);
+    vector<double> old_values(values.size() * 2);
+    old_keys.swap(keys);
+    old_values.swap(values);
+
+    for (unsigned long old_slot = 0; old_slot < old_keys.size(); old_slot++) {
+        if (old_keys[old_slot] != EMPTY_KEY) {
+            unsigned long slot = findSlot(old_keys[old_slot]);
+            keys[slot] = old_keys[old_slot];
+            values[slot] = old_values[old_slot];
+        }
+    }
+}
+
+
+bool DistanceCache::get(unsigned int i, unsigned int j, double* distance) {
+    if (triangular) {
+        double cached = matrix[matrixIndex(i, j)];
+        if (!std::isnan(cached)) {
+            *distance = cached;
+            hit_num++;
+            return true;
+        }
+    }
+    else {
+        uint64_t key = pairKey(i, j);
+        unsigned long slot = findSlot(key);
+        if (keys[slot] == key) {
+            *distance = values[slot];
+            hit_num++;
+            return true;
+        }
+    }
+
+    miss_num++;
+    return false;
+}
+
+
+void DistanceCache::set(unsigned int i, unsigned int j, double distance) {
+    if (triangular) {
+        matrix[matrixIndex(i, j)] = distance;
+        return;
+    }
+
+    uint64_t key = pairKey(i, j);
+    unsigned long slot = findSlot(key);
+    if (keys[slot] != key) {
+        // Keep the load factor at most one half
+        if ((pair_num + 1) * 2 > keys.size()) {
+            growHashtable();
+            slot = findSlot(key);
+        }
+        keys[slot] = key;
+        pair_num++;
+    }
+    values[slot] = distance;
+}
+
+
+bool DistanceCache::isTriangular() { return triangular; }
+
+
+unsigned long DistanceCache::getHitNumber() { return hit_num; }
+
+
+unsigned long DistanceCache::getMissNumber() { return miss_num; }
+
+
+unsigned long DistanceCache::getSize() {
+    return sizeof(*this) + matrix.size() * sizeof(double) + keys.size() * sizeof(uint64_t) +
+            values.size() * sizeof(double);
+}
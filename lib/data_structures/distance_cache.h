@@ -0,0 +1,62 @@
+#ifndef LIB_DISTANCE_CACHE_H
+#define LIB_DISTANCE_CACHE_H
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Distance Cache
+ *
+ * Cache of already calculated distances between pairs of vectors, with each vector identified by a dense index
+ * (usually its position in the input vector, or in whatever group of vectors the caller works on)
+ * Distances are symmetric, so the pair (i, j) is the same as (j, i)
+ *
+ * When a packed triangular matrix of all pairs fits in the given memory budget it is used directly, otherwise the
+ * distances are kept in an open addressing hashtable with linear probing, keyed by both indexes packed in 64 bits
+ *
+ * Counts lookups that found a distance (hits) and ones that did not (misses)
+ * Not thread safe, every thread needs its own cache
+ */
+
+// Default memory budget for the triangular matrix, in bytes
+const unsigned long DISTANCE_CACHE_BUDGET = 256UL * 1024 * 1024;
+
+
+class DistanceCache {
+private:
+    unsigned int index_num;
+    bool triangular;
+
+    // Packed lower triangle, including the diagonal, missing distances are NaN
+    std::vector<double> matrix;
+
+    // Open addressing hashtable, capacity is always a power of two
+    std::vector<uint64_t> keys;
+    std::vector<double> values;
+    unsigned long pair_num;
+
+    unsigned long hit_num;
+    unsigned long miss_num;
+
+    unsigned long matrixIndex(unsigned int i, unsigned int j);
+    uint64_t pairKey(unsigned int i, unsigned int j);
+    unsigned long findSlot(uint64_t key);
+    void growHashtable();
+
+public:
+    DistanceCache(unsigned int in_index_num, unsigned long memory_budget = DISTANCE_CACHE_BUDGET);
+
+    // If the distance of i and j is cached, write it to distance and return true
+    bool get(unsigned int i, unsigned int j, double* distance);
+    void set(unsigned int i, unsigned int j, double distance);
+
+    bool isTriangular();
+    unsigned long getHitNumber();
+    unsigned long getMissNumber();
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+#endif //LIB_DISTANCE_CACHE_H
@@ -0,0 +1,61 @@
+#include <vector>
+
+#include "kmeans_bounds.h"
+
+using namespace std;
+
+KMeansBounds::KMeansBounds(unsigned int vector_num, unsigned int cluster_num, unsigned int chunk_num) :
+        upper_bounds(vector_num, 0), lower_bounds(vector_num, 0), half_center_dists(cluster_num, 0),
+        initialized(false), chunk_computed_nums(chunk_num, 0), chunk_pruned_nums(chunk_num, 0) {}
+
+
+void KMeansBounds::setBounds(unsigned int vector_i, double upper_bound, double lower_bound) {
+    upper_bounds[vector_i] = upper_bound;
+    lower_bounds[vector_i] = lower_bound;
+}
+
+
+void KMeansBounds::setHalfCenterDist(unsigned int cluster_i, double half_dist) { half_center_dists[cluster_i] = half_dist; }
+
+
+void KMeansBounds::setInitialized() { initialized = true; }
+
+
+void KMeansBounds::addComputed(unsigned int chunk_i, unsigned long computed_num) {
+    chunk_computed_nums[chunk_i] = chunk_computed_nums[chunk_i] + computed_num;
+}
+
+
+void KMeansBounds::addPruned(unsigned int chunk_i, unsigned long pruned_num) {
+    chunk_pruned_nums[chunk_i] = chunk_pruned_nums[chunk_i] + pruned_num;
+}
+
+
+double KMeansBounds::getUpperBound(unsigned int vector_i) { return upper_bounds[vector_i]; }
+
+
+double KMeansBounds::getLowerBound(unsigned int vector_i) { return lower_bounds[vector_i]; }
+
+
+double KMeansBounds::getHalfCenterDist(unsigned int cluster_i) { return half_center_dists[cluster_i]; }
+
+
+bool KMeansBounds::isInitialized() { return initialized; }
+
+
+unsigned long KMeansBounds::getComputedNumber() {
+    unsigned long computed_num = 0;
+    for (auto chunk_computed_num : chunk_computed_nums)
+        computed_num = computed_num + chunk_computed_num;
+
+    return computed_num;
+}
+
+
+unsigned long KMeansBounds::getPrunedNumber() {
+    unsigned long pruned_num = 0;
+    for (auto chunk_pruned_num : chunk_pruned_nums)
+        pruned_num = pruned_num + chunk_pruned_num;
+
+    return pruned_num;
+}
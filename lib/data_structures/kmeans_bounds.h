@@ -0,0 +1,53 @@
+#ifndef LIB_KMEANS_BOUNDS_H
+#define LIB_KMEANS_BOUNDS_H
+
+#include <vector>
+
+/*
+ * K-means Bounds
+ *
+ * State kept between iterations by Hamerly's accelerated assignment (euclidean distance only)
+ * For each input vector, an upper bound of its distance from the center of its cluster and a lower bound of its
+ * distance from every other center, and for each center, half the distance to its closest other center
+ * Together with the triangle inequality they prove when a vector cannot have changed cluster, so its distances do
+ * not need to be calculated again
+ *
+ * Also counts how many vector to center distances were calculated and how many were skipped, per chunk of the input
+ * so that parallel chunks do not share counters
+ */
+
+
+class KMeansBounds {
+private:
+    std::vector<double> upper_bounds;
+    std::vector<double> lower_bounds;
+    std::vector<double> half_center_dists;
+    // Bounds are only valid after the first assignment
+    bool initialized;
+
+    std::vector<unsigned long> chunk_computed_nums;
+    std::vector<unsigned long> chunk_pruned_nums;
+
+public:
+    KMeansBounds(unsigned int vector_num, unsigned int cluster_num, unsigned int chunk_num);
+
+    void setBounds(unsigned int vector_i, double upper_bound, double lower_bound);
+    void setHalfCenterDist(unsigned int cluster_i, double half_dist);
+    void setInitialized();
+
+    // Add to the counters of a chunk
+    void addComputed(unsigned int chunk_i, unsigned long computed_num);
+    void addPruned(unsigned int chunk_i, unsigned long pruned_num);
+
+    double getUpperBound(unsigned int vector_i);
+    double getLowerBound(unsigned int vector_i);
+    double getHalfCenterDist(unsigned int cluster_i);
+    bool isInitialized();
+
+    // Totals over all chunks and iterations
+    unsigned long getComputedNumber();
+    unsigned long getPrunedNumber();
+};
+
+
+#endif //LIB_KMEANS_BOUNDS_H
@@ -0,0 +1,134 @@
+#ifndef LIB_KMEANS_CENTERS_H
+#define LIB_KMEANS_CENTERS_H
+
+#include <vector>
+
+#include "cust_vector.hpp"
+#include "cluster_sums.hpp"
+
+/*
+ * K-means Centers
+ *
+ * Buffers used by the fused Lloyd's assignment and k_means update, allocated once before clustering begins
+ * Holds the current centers, the buffer that the next centers are calculated into and the per chunk cluster sums
+ * gathered during the assignment
+ *
+ * When the next centers are accepted the two center buffers are swapped, so no clustering iteration allocates anything
+ *
+ * The centers are copies of the initial centroids, owned by this object, so nothing needs to be deleted afterwards
+ *
+ * Templated, so that it can have any dimension type
+ */
+
+
+template <typename dim_type>
+class KMeansCenters {
+private:
+    std::vector< CustVector<dim_type> > centers;
+    std::vector< CustVector<dim_type> > next_centers;
+    // Pointers to the current centers, for functions that expect centroids as CustVector pointers
+    std::vector< CustVector<dim_type>* > center_ptrs;
+
+    std::vector< ClusterSums<dim_type> > chunk_sums;
+    // Distance of each center from its previous position, after the last swap
+    std::vector<double> center_moves;
+
+public:
+    KMeansCenters(std::vector< CustVector<dim_type>* >& initial_centers, unsigned int chunk_num);
+
+    // Make the next centers the current ones
+    void swapCenters();
+    void setCenterMove(int cluster_i, double move);
+
+    std::vector< CustVector<dim_type>* >& getCenters();
+    CustVector<dim_type>* getCenter(int cluster_i);
+    CustVector<dim_type>* getNextCenter(int cluster_i);
+    ClusterSums<dim_type>& getChunkSums(unsigned int chunk_i);
+    double getCenterMove(int cluster_i);
+    unsigned int getClusterNumber();
+    unsigned int getChunkNumber();
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+KMeansCenters<dim_type>::KMeansCenters(std::vector< CustVector<dim_type>* >& initial_centers, unsigned int chunk_num) {
+    unsigned int dim_num = initial_centers[0]->getDimNumber();
+
+    for (auto initialCenter : initial_centers) {
+        centers.emplace_back("k_means_center", *(initialCenter->getDimensions()));
+        next_centers.emplace_back("k_means_center", *(initialCenter->getDimensions()));
+    }
+    for (auto& center : centers)
+        center_ptrs.push_back(&center);
+
+    if (chunk_num == 0)
+        chunk_num = 1;
+    chunk_sums.resize(chunk_num, ClusterSums<dim_type>(initial_centers.size(), dim_num));
+    center_moves.resize(initial_centers.size(), 0);
+}
+
+
+template <typename dim_type>
+void KMeansCenters<dim_type>::swapCenters() {
+    // Swapping the vectors only exchanges their buffers, so the pointers have to follow
+    centers.swap(next_centers);
+    for (unsigned int cluster_i = 0; cluster_i < centers.size(); cluster_i++)
+        center_ptrs[cluster_i] = &centers[cluster_i];
+}
+
+
+template <typename dim_type>
+void KMeansCenters<dim_type>::setCenterMove(int cluster_i, double move) { center_moves[cluster_i] = move; }
+
+
+template <typename dim_type>
+std::vector< CustVector<dim_type>* >& KMeansCenters<dim_type>::getCenters() { return center_ptrs; }
+
+
+template <typename dim_type>
+CustVector<dim_type>* KMeansCenters<dim_type>::getCenter(int cluster_i) { return &centers[cluster_i]; }
+
+
+template <typename dim_type>
+CustVector<dim_type>* KMeansCenters<dim_type>::getNextCenter(int cluster_i) { return &next_centers[cluster_i]; }
+
+
+template <typename dim_type>
+ClusterSums<dim_type>& KMeansCenters<dim_type>::getChunkSums(unsigned int chunk_i) { return chunk_sums[chunk_i]; }
+
+
+template <typename dim_type>
+double KMeansCenters<dim_type>::getCenterMove(int cluster_i) { return center_moves[cluster_i]; }
+
+
+template <typename dim_type>
+unsigned int KMeansCenters<dim_type>::getClusterNumber() { return centers.size(); }
+
+
+template <typename dim_type>
+unsigned int KMeansCenters<dim_type>::getChunkNumber() { return chunk_sums.size(); }
+
+
+template <typename dim_type>
+unsigned long KMeansCenters<dim_type>::getSize() {
+    unsigned long size = sizeof(*this);
+    if (!centers.empty()) {
+        unsigned long dim_size = centers[0].getDimNumber() * sizeof(dim_type);
+        size = size + 2 * centers.size() * (sizeof(CustVector<dim_type>) + dim_size);
+        size = size + chunk_sums.size() * centers.size() * (dim_size + sizeof(int));
+    }
+    size = size + center_ptrs.size() * sizeof(CustVector<dim_type>*);
+    size = size + center_moves.size() * sizeof(double);
+
+    return size;
+}
+
+
+#endif //LIB_KMEANS_CENTERS_H
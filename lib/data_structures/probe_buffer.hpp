@@ -0,0 +1,109 @@
+#ifndef LIB_PROBE_BUFFER_H
+#define LIB_PROBE_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "../generators/multi_probe.hpp"
+#include "bucket_view.hpp"
+
+/*
+ * Probe Buffer
+ *
+ * Buffers of the multi-probe lookups of a query, the inner products of the query with the projections, the hashes of
+ * its probes, their perturbation sets and the filtered views of the buckets they point to
+ *
+ * Like a candidate set, one buffer is reused for all the queries (and hashtables) of a thread, the buffers are only
+ * resized when a lookup needs more than they already have, so once they are big enough for the k and the probe
+ * number used, a lookup allocates nothing
+ *
+ * Not thread safe, every thread needs its own probe buffer
+ *
+ * Templated, so that it can hold the views of any type of hashtable (int, float type dimensions)
+ */
+
+
+template <typename dim_type>
+class ProbeBuffer {
+private:
+    std::vector<double> inner_products;
+    std::vector<int> probe_hashes;
+    std::vector<int> probe_det_hashes;
+    PerturbationBuffer perturbations;
+
+    // Bucket index and detailed hash fingerprint of the probes already viewed, to skip repeated probes
+    std::vector< std::pair<unsigned int, uint64_t> > probed;
+    std::vector< FilteredBucketView<dim_type> > views;
+
+public:
+    // Make room for probe_num probes, of a hash generator with projection_num projections and det_hash_num values in
+    // its detailed hash, and clear the probes and views of the last lookup
+    void fit(unsigned int projection_num, unsigned int probe_num, unsigned int det_hash_num);
+
+    double* getInnerProducts();
+    int* getProbeHashes();
+    int* getProbeDetHashes();
+    PerturbationBuffer* getPerturbations();
+    std::vector< std::pair<unsigned int, uint64_t> >& getProbed();
+    std::vector< FilteredBucketView<dim_type> >& getViews();
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+void ProbeBuffer<dim_type>::fit(unsigned int projection_num, unsigned int probe_num, unsigned int det_hash_num) {
+    // Shrinking a vector keeps its capacity, so only growing past it allocates
+    inner_products.resize(projection_num);
+    probe_hashes.resize(probe_num);
+    probe_det_hashes.resize(probe_num * det_hash_num);
+    probed.clear();
+    views.clear();
+}
+
+
+template <typename dim_type>
+double* ProbeBuffer<dim_type>::getInnerProducts() { return inner_products.data(); }
+
+
+template <typename dim_type>
+int* ProbeBuffer<dim_type>::getProbeHashes() { return probe_hashes.data(); }
+
+
+template <typename dim_type>
+int* ProbeBuffer<dim_type>::getProbeDetHashes() { return probe_det_hashes.data(); }
+
+
+template <typename dim_type>
+PerturbationBuffer* ProbeBuffer<dim_type>::getPerturbations() { return &perturbations; }
+
+
+template <typename dim_type>
+std::vector< std::pair<unsigned int, uint64_t> >& ProbeBuffer<dim_type>::getProbed() { return probed; }
+
+
+template <typename dim_type>
+std::vector< FilteredBucketView<dim_type> >& ProbeBuffer<dim_type>::getViews() { return views; }
+
+
+template <typename dim_type>
+unsigned long ProbeBuffer<dim_type>::getSize() {
+    unsigned long size = sizeof(*this);
+    size = size + inner_products.capacity()*sizeof(double);
+    size = size + probe_hashes.capacity()*sizeof(int);
+    size = size + probe_det_hashes.capacity()*sizeof(int);
+    size = size + perturbations.getSize() - sizeof(PerturbationBuffer);
+    size = size + probed.capacity()*sizeof(std::pair<unsigned int, uint64_t>);
+    size = size + views.capacity()*sizeof(FilteredBucketView<dim_type>);
+
+    return size;
+}
+
+
+#endif //LIB_PROBE_BUFFER_H
@@ -0,0 +1,95 @@
+#ifndef LIB_USER_MATRIX_H
+#define LIB_USER_MATRIX_H
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * User Matrix
+ *
+ * Dimensions of many vectors stored row-major in one contiguous buffer, with every row padded and aligned to 64 bytes,
+ * so that blocked algorithms (eg. the parallel silhouette) can go over the rows of a whole cluster while they stay in
+ * cache, without following a pointer per vector
+ *
+ * Templated, so that it can store any type of vector (int, float type dimensions)
+ */
+
+
+template <typename dim_type>
+class UserMatrix {
+private:
+    unsigned int row_num;
+    unsigned int dim_num;
+    // Number of elements between the start of two consecutive rows, rows are padded to a multiple of 64 bytes
+    unsigned int row_stride;
+
+    // Backing storage and its first 64-byte aligned element
+    std::vector<dim_type> storage;
+    dim_type* dimensions;
+
+public:
+    // Zero filled matrix of given shape
+    UserMatrix(unsigned int rows, unsigned int dims);
+
+    // The aligned pointer points inside storage, so copying would leave it dangling
+    UserMatrix(const UserMatrix<dim_type>&) = delete;
+    UserMatrix<dim_type>& operator=(const UserMatrix<dim_type>&) = delete;
+
+    dim_type* getRowData(unsigned int row);
+
+    unsigned int getRowNumber();
+    unsigned int getDimNumber();
+    unsigned int getRowStride();
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+UserMatrix<dim_type>::UserMatrix(unsigned int rows, unsigned int dims) {
+    row_num = rows;
+    dim_num = dims;
+
+    unsigned int per_line = 64 / sizeof(dim_type);
+    if (per_line == 0)
+        per_line = 1;
+    row_stride = ( (dim_num + per_line - 1) / per_line ) * per_line;
+
+    // Over-allocate by one cache line, so that the first row can start at a 64-byte boundary
+    storage.assign((unsigned long) row_num * row_stride + per_line, dim_type(0));
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+    unsigned long offset = ( (64 - address % 64) % 64 ) / sizeof(dim_type);
+    dimensions = storage.data() + offset;
+}
+
+
+template <typename dim_type>
+dim_type* UserMatrix<dim_type>::getRowData(unsigned int row) { return dimensions + (unsigned long) row * row_stride; }
+
+
+template <typename dim_type>
+unsigned int UserMatrix<dim_type>::getRowNumber() { return row_num; }
+
+
+template <typename dim_type>
+unsigned int UserMatrix<dim_type>::getDimNumber() { return dim_num; }
+
+
+template <typename dim_type>
+unsigned int UserMatrix<dim_type>::getRowStride() { return row_stride; }
+
+
+template <typename dim_type>
+unsigned long UserMatrix<dim_type>::getSize() {
+    unsigned long size = sizeof(*this);
+    size = size + storage.capacity()*sizeof(dim_type);
+
+    return size;
+}
+
+#endif //LIB_USER_MATRIX_H
@@ -0,0 +1,50 @@
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "user_sentiments.h"
+
+using namespace std;
+
+UserSentiments::UserSentiments(int crypto_num) : crypto_num(crypto_num) {}
+
+
+int UserSentiments::addUser(const string& user_id) {
+    auto found = user_indexes.find(user_id);
+    if (found != user_indexes.end())
+        return found->second;
+
+    int user_i = user_ids.size();
+    user_ids.emplace_back(user_id);
+    user_indexes.emplace(user_id, user_i);
+    scores.resize(scores.size() + crypto_num, 0);
+    mentioned.resize(mentioned.size() + crypto_num, 0);
+
+    return user_i;
+}
+
+
+void UserSentiments::addTweet(int user_i, Tweet& tweet) {
+    double score = tweet.getSentimentScore();
+    for (int index : tweet.getCryptoIndexes()) {
+        if (score > 0)
+            scores[user_i * crypto_num + index] = scores[user_i * crypto_num + index] + score;
+
+        mentioned[user_i * crypto_num + index] = 1;
+    }
+}
+
+
+int UserSentiments::getUserNumber() { return user_ids.size(); }
+
+
+int UserSentiments::getCryptoNumber() { return crypto_num; }
+
+
+string UserSentiments::getUserId(int user_i) { return user_ids[user_i]; }
+
+
+double UserSentiments::getScore(int user_i, int crypto_i) { return scores[user_i * crypto_num + crypto_i]; }
+
+
+bool UserSentiments::isMentioned(int user_i, int crypto_i) { return mentioned[user_i * crypto_num + crypto_i] != 0; }
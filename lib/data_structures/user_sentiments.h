@@ -0,0 +1,52 @@
+#ifndef LIB_USER_SENTIMENTS_H
+#define LIB_USER_SENTIMENTS_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "tweet.h"
+
+/*
+ * User Sentiments
+ *
+ * Accumulates the sentiment of users for every cryptocurrency, one tweet at a time, so that tweets can be discarded
+ * as soon as they are read
+ *
+ * For each user, it stores the sum of the positive sentiment scores of its tweets that mention each cryptocurrency,
+ * and whether each cryptocurrency has been mentioned at all (in which case it is a known score of the user)
+ * Users are kept in the order they were added, so memory depends on the number of users and not on the number of
+ * tweets
+ *
+ * A user can be anything tweets are grouped by, eg. the user that posted them or the cluster of their vectors
+ */
+
+
+class UserSentiments {
+private:
+    int crypto_num;
+    std::vector<std::string> user_ids;
+    std::unordered_map<std::string, int> user_indexes;
+
+    // Row by row for every user (user number x crypto_num)
+    std::vector<double> scores;
+    std::vector<char> mentioned;
+
+public:
+    UserSentiments(int crypto_num);
+
+    // Add a user, if it does not exist, and return its index
+    int addUser(const std::string& user_id);
+
+    // Add the sentiment of a tweet to the scores of a user, for every cryptocurrency it mentions
+    void addTweet(int user_i, Tweet& tweet);
+
+    int getUserNumber();
+    int getCryptoNumber();
+    std::string getUserId(int user_i);
+    double getScore(int user_i, int crypto_i);
+    bool isMentioned(int user_i, int crypto_i);
+};
+
+
+#endif //LIB_USER_SENTIMENTS_H
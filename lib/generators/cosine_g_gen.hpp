@@ -3,9 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <cmath>
+#include <algorithm>
 
 #include "hash_generator.hpp"
 #include "cosine_h_gen.hpp"
+#include "multi_probe.hpp"
 #include "../data_structures/cust_vector.hpp"
 
 /*
@@ -17,6 +20,9 @@
  * Creates an input number of CosineHGen objects, which calls during its hash
  * generation process
  *
+ * For multi-probe queries, the bits whose inner products are closest to 0 are the ones most likely to be different
+ * for the neighbors of the target, so the probes flip the sets of bits with the smallest such margins
+ *
  * Templated, so that it can generate hashes for any type of vector (int, float type dimensions)
  */
 
@@ -29,12 +35,19 @@ public:
     CosineGGen(int k, int dim_num, std::default_random_engine* rand_generator);
     ~CosineGGen();
 
-    int generate(CustVector<dim_type>* hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
+    unsigned int hashProbes(const double* inner_products, unsigned int probe_num, int* probe_hashes,
+                            int* probe_det_hashes, PerturbationBuffer* perturbations) const;
 
     // Creates a hash from given hash values, but the hash completely represents the hash values
     // So there is not need to store the detailed hashes
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -59,23 +72,95 @@ CosineGGen<dim_type>::~CosineGGen() {
 }
 
 template <typename dim_type>
-int CosineGGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
+int CosineGGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    int hash_num = 0;
+    for (int i = 0; i < hFunctions.size(); i++) {
+        hash_num = hash_num << 1;
+
+        int hi = hFunctions[i]->hash(hashTarget);
+        hash_num = hash_num + hi;
+    }
+
+    return hash_num;
+}
+
+template <typename dim_type>
+unsigned int CosineGGen<dim_type>::getProjectionNumber() const {
+    unsigned int projection_num = 0;
+    for (int i = 0; i < hFunctions.size(); i++)
+        projection_num = projection_num + hFunctions[i]->getProjectionNumber();
+
+    return projection_num;
+}
+
+
+template <typename dim_type>
+void CosineGGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    for (int i = 0; i < hFunctions.size(); i++)
+        hFunctions[i]->getProjections(projections);
+}
+
+
+template <typename dim_type>
+void CosineGGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    for (int i = 0; i < hFunctions.size(); i++) {
+        hFunctions[i]->projectDimensions(dimensions, inner_products);
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
+    }
+}
+
+
+template <typename dim_type>
+int CosineGGen<dim_type>::hashProjections(const double* inner_products, int* /*detailed_hash*/) const {
     int hash_num = 0;
     for (int i = 0; i < hFunctions.size(); i++) {
         hash_num = hash_num << 1;
 
-        int hi = hFunctions[i]->generate(hashTarget);
+        int hi = hFunctions[i]->hashProjections(inner_products, nullptr);
         hash_num = hash_num + hi;
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
     }
 
     return hash_num;
 }
 
+
+template <typename dim_type>
+unsigned int CosineGGen<dim_type>::hashProbes(const double* inner_products, unsigned int probe_num, int* probe_hashes,
+                                              int* /*probe_det_hashes*/, PerturbationBuffer* perturbations) const {
+    probe_hashes[0] = hashProjections(inner_products, nullptr);
+    if (probe_num <= 1)
+        return 1;
+
+    // Flipping bit i is perturbation i, scored by its margin
+    perturbations->clear();
+    for (int i = 0; i < hFunctions.size(); i++) {
+        perturbations->addPerturbation(fabs(inner_products[0]), i);
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
+    }
+
+    // Every set of bits can be flipped together
+    perturbations->generateSets(probe_num - 1, [](const std::vector<unsigned int>&) { return true; });
+
+    unsigned int probe_i = 1;
+    for (unsigned int set_i = 0; set_i < perturbations->getSetNumber(); set_i++) {
+        int hash_num = probe_hashes[0];
+        // The first h hash is the highest bit
+        for (const unsigned int* it = perturbations->setBegin(set_i); it != perturbations->setEnd(set_i); ++it)
+            hash_num = hash_num ^ (1 << (hFunctions.size() - 1 - perturbations->getPerturbationId(*it)));
+        probe_hashes[probe_i] = hash_num;
+        probe_i++;
+    }
+
+    return probe_i;
+}
+
+
 template <typename dim_type>
 bool CosineGGen<dim_type>::hasDetailedHash() { return false; }
 
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* CosineGGen<dim_type>::getDetailedHashes() { return nullptr; }
+unsigned int CosineGGen<dim_type>::getDetailedHashNumber() { return 0; }
 
 
 template <typename dim_type>
@@ -29,15 +29,23 @@ class CosineHGen : public HashGenerator<dim_type> {
 private:
     CustVector<double>* r;
 
+    // Hash of raw dimensions
+    int hashDimensions(const dim_type* dimensions) const;
+
 public:
     CosineHGen(int dim_num, std::default_random_engine* rand_generator);
     ~CosineHGen();
 
-    int generate(CustVector<dim_type>* hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
 
     // No detailed hashes in this hash generator, but must implement "interface"
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -66,10 +74,40 @@ CosineHGen<dim_type>::~CosineHGen() {
 }
 
 template <typename dim_type>
-int CosineHGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
-    long double inner_prod = r->inner_product<dim_type>(hashTarget, 0.0);
+int CosineHGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    return hashDimensions(hashTarget.getDimensions()->data());
+}
+
+
+template <typename dim_type>
+int CosineHGen<dim_type>::hashDimensions(const dim_type* dimensions) const {
+    // Same kernel as the batched inner products, so that both give exactly the same hash
+    double inner_prod;
+    projectDimensions(dimensions, &inner_prod);
+
+    return hashProjections(&inner_prod, nullptr);
+}
+
+
+template <typename dim_type>
+unsigned int CosineHGen<dim_type>::getProjectionNumber() const { return 1; }
 
-    if (inner_prod >= 0)
+
+template <typename dim_type>
+void CosineHGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    projections->insert(projections->end(), r->getDimensions()->begin(), r->getDimensions()->end());
+}
+
+
+template <typename dim_type>
+void CosineHGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    projection_kernel(&dimensions, 1, r->getDimNumber(), r->getDimensions()->data(), 1, inner_products);
+}
+
+
+template <typename dim_type>
+int CosineHGen<dim_type>::hashProjections(const double* inner_products, int* /*detailed_hash*/) const {
+    if (inner_products[0] >= 0)
         return 1;
     else
         return 0;
@@ -83,7 +121,7 @@ bool CosineHGen<dim_type>::hasDetailedHash() { return false; }
 
 // This method exists just to implement the interface
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* CosineHGen<dim_type>::getDetailedHashes() { return nullptr; }
+unsigned int CosineHGen<dim_type>::getDetailedHashNumber() { return 0; }
 
 
 template <typename dim_type>
@@ -5,7 +5,7 @@
 #include <vector>
 #include <random>
 #include <cmath>
-#include <unordered_map>
+#include <cstdint>
 
 #include "hash_generator.hpp"
 #include "euclidean_h_gen.hpp"
@@ -19,7 +19,8 @@
  *
  * Creates an EuclideanHGen object, which calls during its hash generation process
  *
- * Stores all previous hashes of each vector that it generates a hash for in a map so as to be concise
+ * Each h value is mapped to a random bit, derived from a seeded hash of the h value instead of a random draw, so the
+ * same h value always gets the same bit without storing anything while hashing
  *
  * Templated, so that it can generate hashes for any type of vector (int, float type dimensions)
  */
@@ -28,18 +29,26 @@ template <typename dim_type>
 class EuclideanFGen : public HashGenerator<dim_type> {
 private:
     EuclideanHGen<dim_type>* hGenerator;
-    std::default_random_engine* rand_generator;
-    std::unordered_map<int, int> num_to_bin_hashes;
+    // Seed of the h value to bit mapping
+    uint64_t bit_seed;
+
+    // Random bit of an h value
+    int bitOf(int hash_num) const;
 
 public:
     EuclideanFGen(int dim_num, float in_w, std::default_random_engine* rand_gen);
     ~EuclideanFGen();
 
-    int generate(CustVector<dim_type>* hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
 
     // No detailed hashes in this hash generator, but must implement "interface"
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -52,8 +61,8 @@ public:
 
 template <typename dim_type>
 EuclideanFGen<dim_type>::EuclideanFGen(int dim_num, float in_w, std::default_random_engine* rand_gen) {
-    rand_generator = rand_gen;
     hGenerator = new EuclideanHGen<dim_type>(dim_num, in_w, rand_gen);
+    bit_seed = ((uint64_t) (*rand_gen)() << 32) ^ (*rand_gen)();
 }
 
 template <typename dim_type>
@@ -62,20 +71,42 @@ EuclideanFGen<dim_type>::~EuclideanFGen() {
 }
 
 template <typename dim_type>
-int EuclideanFGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
-    int hash_result;
-    int hash_num = hGenerator->generate(hashTarget);
-    if (num_to_bin_hashes.count(hash_num) == 1) {
-        hash_result = num_to_bin_hashes[hash_num];
-    }
-    else {
-        std::uniform_int_distribution<int> uni_distribution(1, 2);
-        hash_result = mod(hash_num, uni_distribution(*rand_generator));
-
-        num_to_bin_hashes.emplace(hash_num, hash_result);
-    }
-
-    return hash_result;
+int EuclideanFGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    return bitOf( hGenerator->hash(hashTarget) );
+}
+
+
+template <typename dim_type>
+unsigned int EuclideanFGen<dim_type>::getProjectionNumber() const { return hGenerator->getProjectionNumber(); }
+
+
+template <typename dim_type>
+void EuclideanFGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    hGenerator->getProjections(projections);
+}
+
+
+template <typename dim_type>
+int EuclideanFGen<dim_type>::hashProjections(const double* inner_products, int* /*detailed_hash*/) const {
+    return bitOf( hGenerator->hashProjections(inner_products, nullptr) );
+}
+
+
+template <typename dim_type>
+void EuclideanFGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    hGenerator->projectDimensions(dimensions, inner_products);
+}
+
+
+template <typename dim_type>
+int EuclideanFGen<dim_type>::bitOf(int hash_num) const {
+    // Mix the seeded h value (splitmix64 finalizer), so that every h value gets an independent random looking bit
+    uint64_t mixed = (uint64_t) (uint32_t) hash_num + bit_seed;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    mixed = mixed ^ (mixed >> 31);
+
+    return int(mixed & 1);
 }
 
 template <typename dim_type>
@@ -83,15 +114,13 @@ bool EuclideanFGen<dim_type>::hasDetailedHash() { return false; }
 
 
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* EuclideanFGen<dim_type>::getDetailedHashes() { return nullptr; }
+unsigned int EuclideanFGen<dim_type>::getDetailedHashNumber() { return 0; }
 
 
 template <typename dim_type>
 unsigned long EuclideanFGen<dim_type>::getSize() {
     unsigned long size = sizeof(*this);
     size = size + hGenerator->getSize();
-    size = size + sizeof(rand_generator);
-    size = size + num_to_bin_hashes.size() * 2*sizeof(int);
 
     return size;
 }
@@ -31,19 +31,31 @@
 template <typename dim_type>
 class EuclideanHGen : public HashGenerator<dim_type> {
 private:
-    CustVector<float> *v;
+    // Normally distributed float dimensions, stored as doubles for the inner product kernels
+    CustVector<double> *v;
     float t;
     float w;
 
+    // Hash of raw dimensions
+    int hashDimensions(const dim_type* dimensions) const;
+
 public:
     EuclideanHGen(int dim_num, float in_w, std::default_random_engine* rand_generator);
     ~EuclideanHGen();
 
-    int generate(CustVector<dim_type> *hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
+    // Position of the projected target in units of w, the hash is its integer part and the fractional part is how
+    // far the target is from the lower border of its slot
+    long double slotPosition(const double* inner_products) const;
 
     // No detailed hashes in this hash generator, but must implement "interface"
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -58,11 +70,11 @@ template <typename dim_type>
 EuclideanHGen<dim_type>::EuclideanHGen(int dim_num, float in_w, std::default_random_engine* rand_generator): w(in_w) {
     // Create v (normal distributed float dimensions)
     std::normal_distribution<float> norm_distribution(0, 1);
-    std::vector<float> temp;
+    std::vector<double> temp;
     temp.reserve(dim_num);
     for (int i = 0; i < dim_num; i++)
         temp.emplace_back( norm_distribution(*rand_generator) );
-    v = new CustVector<float>("v", temp);
+    v = new CustVector<double>("v", temp);
 
     // Create t (uniformly distributed float)
     std::uniform_real_distribution<float> uni_distribution(0, w);
@@ -76,9 +88,41 @@ EuclideanHGen<dim_type>::~EuclideanHGen() {
 }
 
 template <typename dim_type>
-int EuclideanHGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
-    long double inner_prod = v->inner_product<dim_type>(hashTarget, 0.0);
-    return int( floor( (inner_prod + t) / w ) );
+int EuclideanHGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    return hashDimensions(hashTarget.getDimensions()->data());
+}
+
+template <typename dim_type>
+int EuclideanHGen<dim_type>::hashDimensions(const dim_type* dimensions) const {
+    // Same kernel as the batched inner products, so that both give exactly the same hash
+    double inner_prod;
+    projectDimensions(dimensions, &inner_prod);
+
+    return hashProjections(&inner_prod, nullptr);
+}
+
+template <typename dim_type>
+unsigned int EuclideanHGen<dim_type>::getProjectionNumber() const { return 1; }
+
+template <typename dim_type>
+void EuclideanHGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    projections->insert(projections->end(), v->getDimensions()->begin(), v->getDimensions()->end());
+}
+
+template <typename dim_type>
+void EuclideanHGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    projection_kernel(&dimensions, 1, v->getDimNumber(), v->getDimensions()->data(), 1, inner_products);
+}
+
+template <typename dim_type>
+int EuclideanHGen<dim_type>::hashProjections(const double* inner_products, int* /*detailed_hash*/) const {
+    return int( floor( slotPosition(inner_products) ) );
+}
+
+template <typename dim_type>
+long double EuclideanHGen<dim_type>::slotPosition(const double* inner_products) const {
+    long double inner_prod = inner_products[0];
+    return (inner_prod + t) / w;
 }
 
 // This hash generator does not have any sort of detailed hash and does not do any aggregation from other hashes
@@ -87,7 +131,7 @@ bool EuclideanHGen<dim_type>::hasDetailedHash() { return false; }
 
 // This method exists just to implement the interface
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* EuclideanHGen<dim_type>::getDetailedHashes() { return nullptr; }
+unsigned int EuclideanHGen<dim_type>::getDetailedHashNumber() { return 0; }
 
 
 template <typename dim_type>
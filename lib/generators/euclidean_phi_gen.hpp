@@ -6,9 +6,11 @@
 #include <random>
 #include <cmath>
 #include <unordered_map>
+#include <algorithm>
 
 #include "hash_generator.hpp"
 #include "euclidean_h_gen.hpp"
+#include "multi_probe.hpp"
 #include "../data_structures/cust_vector.hpp"
 
 
@@ -21,8 +23,12 @@
  * Creates an input number of EuclideanHGen objects, which calls during its hash
  * generation process
  *
- * Stores all the detailed hashes of each vector that it generates a hash for,
- * to use later for easier initial comparison between vectors
+ * The h hashes of a vector are its detailed hash, which can be written out while generating the hash, so that a
+ * hashtable can store it for easier initial comparison between vectors
+ *
+ * For multi-probe queries, each h value can move one slot down or up, scored by how close the target is to that
+ * border of its slot, so the probes are the sets of such moves of the h values closest to their borders, each with
+ * its own detailed hash
  *
  * Templated, so that it can generate hashes for any type of vector (int, float type dimensions)
  */
@@ -34,18 +40,29 @@ private:
     std::vector<int> rs;
     int M;
 
-    std::unordered_map<std::string, std::vector<int>> id_to_det_hashes;
+    // Combine the h hashes of a CustVector, also writing them into detailed_hash unless it is nullptr
+    int combineHashes(const CustVector<dim_type>& hashTarget, int* detailed_hash) const;
+    // Combine k already calculated h values
+    int combineHValues(const int* h_values) const;
 
 public:
     EuclideanPhiGen(int k, int dim_num, float in_w, std::default_random_engine* rand_generator);
     ~EuclideanPhiGen();
 
-    int generate(CustVector<dim_type>* hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+    int hash(const CustVector<dim_type>& hashTarget, int* detailed_hash) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
+    unsigned int hashProbes(const double* inner_products, unsigned int probe_num, int* probe_hashes,
+                            int* probe_det_hashes, PerturbationBuffer* perturbations) const;
 
     // Uses EuclideanHGen generators to create a hash
     // The hashes these generators provide are the detailed hash
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -79,30 +96,140 @@ EuclideanPhiGen<dim_type>::~EuclideanPhiGen() {
 
 
 template <typename dim_type>
-int EuclideanPhiGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
-    std::vector<int>detailed_hash;
+int EuclideanPhiGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    return combineHashes(hashTarget, nullptr);
+}
+
+
+template <typename dim_type>
+int EuclideanPhiGen<dim_type>::hash(const CustVector<dim_type>& hashTarget, int* detailed_hash) const {
+    return combineHashes(hashTarget, detailed_hash);
+}
 
+
+template <typename dim_type>
+int EuclideanPhiGen<dim_type>::combineHashes(const CustVector<dim_type>& hashTarget, int* detailed_hash) const {
     unsigned int hash_num = 0;
     for (int i = 0; i < hFunctions.size(); i++) {
-        int hi = hFunctions[i]->generate(hashTarget);
+        int hi = hFunctions[i]->hash(hashTarget);
         long temp = hi * rs[i];
         hash_num = hash_num + mod(temp, M);
 
-        detailed_hash.emplace_back(hi);
+        if (detailed_hash != nullptr)
+            detailed_hash[i] = hi;
     }
 
-    id_to_det_hashes.emplace(hashTarget->getId(), detailed_hash);
+    return mod(hash_num, M);
+}
+
+
+template <typename dim_type>
+unsigned int EuclideanPhiGen<dim_type>::getProjectionNumber() const {
+    unsigned int projection_num = 0;
+    for (int i = 0; i < hFunctions.size(); i++)
+        projection_num = projection_num + hFunctions[i]->getProjectionNumber();
+
+    return projection_num;
+}
+
+
+template <typename dim_type>
+void EuclideanPhiGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    for (int i = 0; i < hFunctions.size(); i++)
+        hFunctions[i]->getProjections(projections);
+}
+
+
+template <typename dim_type>
+void EuclideanPhiGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    for (int i = 0; i < hFunctions.size(); i++) {
+        hFunctions[i]->projectDimensions(dimensions, inner_products);
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
+    }
+}
+
+
+template <typename dim_type>
+int EuclideanPhiGen<dim_type>::hashProjections(const double* inner_products, int* detailed_hash) const {
+    unsigned int hash_num = 0;
+    for (int i = 0; i < hFunctions.size(); i++) {
+        int hi = hFunctions[i]->hashProjections(inner_products, nullptr);
+        long temp = hi * rs[i];
+        hash_num = hash_num + mod(temp, M);
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
+
+        if (detailed_hash != nullptr)
+            detailed_hash[i] = hi;
+    }
 
     return mod(hash_num, M);
 }
 
 
+template <typename dim_type>
+int EuclideanPhiGen<dim_type>::combineHValues(const int* h_values) const {
+    unsigned int hash_num = 0;
+    for (int i = 0; i < hFunctions.size(); i++) {
+        long temp = h_values[i] * rs[i];
+        hash_num = hash_num + mod(temp, M);
+    }
+
+    return mod(hash_num, M);
+}
+
+
+template <typename dim_type>
+unsigned int EuclideanPhiGen<dim_type>::hashProbes(const double* inner_products, unsigned int probe_num,
+                                                   int* probe_hashes, int* probe_det_hashes,
+                                                   PerturbationBuffer* perturbations) const {
+    unsigned int k = hFunctions.size();
+    probe_hashes[0] = hashProjections(inner_products, probe_det_hashes);
+    if (probe_num <= 1)
+        return 1;
+
+    // Moving h value i down is perturbation 2i, scored by the distance from the lower border of its slot, and moving it
+    // up is perturbation 2i + 1, scored by the distance from the upper border
+    perturbations->clear();
+    for (unsigned int i = 0; i < k; i++) {
+        long double position = hFunctions[i]->slotPosition(inner_products);
+        double lower_dist = double( position - floor(position) );
+        perturbations->addPerturbation(lower_dist, 2 * i);
+        perturbations->addPerturbation(1 - lower_dist, 2 * i + 1);
+        inner_products = inner_products + hFunctions[i]->getProjectionNumber();
+    }
+
+    // An h value can only move one way in a probe
+    perturbations->generateSets(probe_num - 1, [&](const std::vector<unsigned int>& move_set) {
+        for (unsigned int a = 0; a < move_set.size(); a++)
+            for (unsigned int b = a + 1; b < move_set.size(); b++)
+                if (perturbations->getPerturbationId(move_set[a]) / 2 ==
+                    perturbations->getPerturbationId(move_set[b]) / 2)
+                    return false;
+        return true;
+    });
+
+    unsigned int probe_i = 1;
+    for (unsigned int set_i = 0; set_i < perturbations->getSetNumber(); set_i++) {
+        int* h_values = probe_det_hashes + probe_i * k;
+        std::copy(probe_det_hashes, probe_det_hashes + k, h_values);
+        for (const unsigned int* it = perturbations->setBegin(set_i); it != perturbations->setEnd(set_i); ++it) {
+            unsigned int perturbation = perturbations->getPerturbationId(*it);
+            h_values[perturbation / 2] = h_values[perturbation / 2] + (perturbation % 2 == 0 ? -1 : 1);
+        }
+        probe_hashes[probe_i] = combineHValues(h_values);
+        probe_i++;
+    }
+
+    return probe_i;
+}
+
+
 template <typename dim_type>
 bool EuclideanPhiGen<dim_type>::hasDetailedHash() { return true; }
 
 
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* EuclideanPhiGen<dim_type>::getDetailedHashes() { return &id_to_det_hashes; }
+unsigned int EuclideanPhiGen<dim_type>::getDetailedHashNumber() { return hFunctions.size(); }
 
 
 template <typename dim_type>
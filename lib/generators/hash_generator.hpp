@@ -1,8 +1,9 @@
 #ifndef LIB_HASH_GENERATOR_H
 #define LIB_HASH_GENERATOR_H
 
-#include <unordered_map>
+#include <vector>
 
+#include "multi_probe.hpp"
 #include "../data_structures/cust_vector.hpp"
 
 
@@ -12,6 +13,8 @@
  * Abstract Class used to calculate the euclidean phi hash value of a given vector
  * Implements the HashGenerator "interface", accepts CustVector objects
  *
+ * Hashing is const and has no side effects, so many threads can hash with the same generator at once
+ *
  * Templated, so that it can "generate" hashes for any type of vector (int, float type dimensions)
  */
 
@@ -22,9 +25,35 @@ class HashGenerator {
 public:
     virtual ~HashGenerator() = 0;
 
-    virtual int generate(CustVector<dim_type>*) = 0;
+    virtual int hash(const CustVector<dim_type>& hashTarget) const = 0;
+
     virtual bool hasDetailedHash() = 0;
-    virtual std::unordered_map<std::string, std::vector<int>>* getDetailedHashes() = 0;
+    // Number of values in the detailed hash, 0 if there is none
+    virtual unsigned int getDetailedHashNumber() = 0;
+
+    // Same hashes, that also write the detailed hash of the target into detailed_hash, if there is one
+    virtual int hash(const CustVector<dim_type>& hashTarget, int* /*detailed_hash*/) const { return hash(hashTarget); }
+
+    // Every hash is calculated from the inner products of the target with a few projection vectors, so the inner
+    // products of many vectors can be calculated at once by the caller (see ProjectionBatch)
+    virtual unsigned int getProjectionNumber() const = 0;
+    // Append the projection vectors, one after the other
+    virtual void getProjections(std::vector<double>* projections) const = 0;
+    // Same hash, from the inner products of the target with the projections, in the order getProjections gives them
+    virtual int hashProjections(const double* inner_products, int* detailed_hash) const = 0;
+    // Inner products of raw dimensions with the projections, for a single target
+    virtual void projectDimensions(const dim_type* dimensions, double* inner_products) const = 0;
+
+    // Multi-probe hashing, write the hashes of up to probe_num buckets to look into, the exact hash first and then the
+    // ones that the neighbors of the target are most likely to be in, with the detailed hash of each probe written
+    // into probe_det_hashes (getDetailedHashNumber values each), and return how many probes were written
+    // The perturbations of the probes are found in a buffer of the caller, so that it can be reused between queries
+    // Generators that cannot tell how close the target is to other buckets only give the exact hash
+    virtual unsigned int hashProbes(const double* inner_products, unsigned int /*probe_num*/, int* probe_hashes,
+                                    int* probe_det_hashes, PerturbationBuffer* /*perturbations*/) const {
+        probe_hashes[0] = hashProjections(inner_products, probe_det_hashes);
+        return 1;
+    }
 
     // Get size of object in bytes
     virtual unsigned long getSize() = 0;
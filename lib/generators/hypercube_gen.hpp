@@ -31,11 +31,16 @@ public:
     // Delete contents of fFunctions vector (hash generator objects)
     ~HypercubeGen();
 
-    int generate(CustVector<dim_type>* hashTarget);
+    int hash(const CustVector<dim_type>& hashTarget) const;
+
+    unsigned int getProjectionNumber() const;
+    void getProjections(std::vector<double>* projections) const;
+    int hashProjections(const double* inner_products, int* detailed_hash) const;
+    void projectDimensions(const dim_type* dimensions, double* inner_products) const;
 
     // No detailed hashes in this hash generator, but must implement "interface"
     bool hasDetailedHash();
-    std::unordered_map<std::string, std::vector<int>>* getDetailedHashes();
+    unsigned int getDetailedHashNumber();
 
     // Get size of object in bytes
     unsigned long getSize();
@@ -60,13 +65,54 @@ HypercubeGen<dim_type>::~HypercubeGen() {
 
 
 template <typename dim_type>
-int HypercubeGen<dim_type>::generate(CustVector<dim_type>* hashTarget) {
+int HypercubeGen<dim_type>::hash(const CustVector<dim_type>& hashTarget) const {
+    int hash_num = 0;
+    for (int i = 0; i < fFunctions.size(); i++) {
+        hash_num = hash_num << 1;
+
+        int hi = fFunctions[i]->hash(hashTarget);
+        hash_num = hash_num + hi;
+    }
+
+    return hash_num;
+}
+
+
+template <typename dim_type>
+unsigned int HypercubeGen<dim_type>::getProjectionNumber() const {
+    unsigned int projection_num = 0;
+    for (int i = 0; i < fFunctions.size(); i++)
+        projection_num = projection_num + fFunctions[i]->getProjectionNumber();
+
+    return projection_num;
+}
+
+
+template <typename dim_type>
+void HypercubeGen<dim_type>::getProjections(std::vector<double>* projections) const {
+    for (int i = 0; i < fFunctions.size(); i++)
+        fFunctions[i]->getProjections(projections);
+}
+
+
+template <typename dim_type>
+void HypercubeGen<dim_type>::projectDimensions(const dim_type* dimensions, double* inner_products) const {
+    for (int i = 0; i < fFunctions.size(); i++) {
+        fFunctions[i]->projectDimensions(dimensions, inner_products);
+        inner_products = inner_products + fFunctions[i]->getProjectionNumber();
+    }
+}
+
+
+template <typename dim_type>
+int HypercubeGen<dim_type>::hashProjections(const double* inner_products, int* /*detailed_hash*/) const {
     int hash_num = 0;
     for (int i = 0; i < fFunctions.size(); i++) {
         hash_num = hash_num << 1;
 
-        int hi = fFunctions[i]->generate(hashTarget);
+        int hi = fFunctions[i]->hashProjections(inner_products, nullptr);
         hash_num = hash_num + hi;
+        inner_products = inner_products + fFunctions[i]->getProjectionNumber();
     }
 
     return hash_num;
@@ -78,7 +124,7 @@ bool HypercubeGen<dim_type>::hasDetailedHash() { return false; }
 
 
 template <typename dim_type>
-std::unordered_map<std::string, std::vector<int>>* HypercubeGen<dim_type>::getDetailedHashes() { return nullptr; }
+unsigned int HypercubeGen<dim_type>::getDetailedHashNumber() { return 0; }
 
 
 template <typename dim_type>
@@ -0,0 +1,175 @@
+#ifndef LIB_MULTI_PROBE_H
+#define LIB_MULTI_PROBE_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+/*
+ * Multi-probe
+ *
+ * Sequence of perturbation sets for multi-probe LSH, used by the hash generators that can tell how close a vector is
+ * to the border of its slot in each of their hash values, so that a query can also look into the buckets its
+ * neighbors are most likely to have fallen in, instead of only its own
+ *
+ * Each possible perturbation (eg. flipping one bit of a cosine hash) has a score, the distance of the vector from the
+ * border it crosses, and the sets are generated in increasing order of the sum of the squared scores of their
+ * perturbations, with a heap that starts from the best single perturbation and either shifts or expands the last
+ * perturbation of each set it takes out
+ *
+ * A set in the heap is only its last perturbation and the set it came from, and the perturbations, the heap and the
+ * sets found are kept in a buffer that is reused between queries, so once it has grown enough, nothing is allocated
+ *
+ * Not thread safe, every thread needs its own buffer
+ */
+
+
+class PerturbationBuffer {
+private:
+    // Perturbations as (score, id) pairs, in increasing order of score once the sets are generated
+    std::vector< std::pair<double, unsigned int> > perturbations;
+
+    // Sets of the heap, each one its last perturbation and the node of the set it was shifted or expanded from, -1 for
+    // none, so a new set adds one node instead of copying all of its perturbations
+    std::vector<unsigned int> node_lasts;
+    std::vector<int> node_parents;
+    // Total squared score and node of the sets in the heap, smallest score on top
+    std::vector< std::pair<double, unsigned int> > heap;
+    // Perturbations of the set being checked, as indexes into the sorted perturbations
+    std::vector<unsigned int> current_set;
+
+    // The sets found, one after the other, set i goes from set_offsets[i] to set_offsets[i + 1]
+    std::vector<unsigned int> set_perturbations;
+    std::vector<unsigned int> set_offsets;
+
+    void pushSet(double score, unsigned int last, int parent);
+
+public:
+    PerturbationBuffer();
+
+    // Start collecting the perturbations of a new query
+    void clear();
+    void addPerturbation(double score, unsigned int id);
+
+    // Sort the perturbations and find the sets with the lowest scores, at most set_num of them
+    // A set is only kept if is_valid returns true for it, given as indexes into the sorted perturbations
+    template <typename Validator>
+    void generateSets(unsigned int set_num, Validator is_valid);
+
+    // Id of a perturbation, by its index in the sorted perturbations
+    unsigned int getPerturbationId(unsigned int sorted_i) const;
+
+    unsigned int getSetNumber() const;
+    const unsigned int* setBegin(unsigned int set_i) const;
+    const unsigned int* setEnd(unsigned int set_i) const;
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+/*
+* Function definitions
+*/
+
+inline PerturbationBuffer::PerturbationBuffer() : set_offsets(1, 0) {}
+
+
+inline void PerturbationBuffer::clear() {
+    perturbations.clear();
+    node_lasts.clear();
+    node_parents.clear();
+    heap.clear();
+    set_perturbations.clear();
+    set_offsets.resize(1);
+}
+
+
+inline void PerturbationBuffer::addPerturbation(double score, unsigned int id) { perturbations.emplace_back(score, id); }
+
+
+inline void PerturbationBuffer::pushSet(double score, unsigned int last, int parent) {
+    node_lasts.emplace_back(last);
+    node_parents.emplace_back(parent);
+    heap.emplace_back(score, node_lasts.size() - 1);
+    std::push_heap(heap.begin(), heap.end(), std::greater< std::pair<double, unsigned int> >());
+}
+
+
+template <typename Validator>
+void PerturbationBuffer::generateSets(unsigned int set_num, Validator is_valid) {
+    node_lasts.clear();
+    node_parents.clear();
+    heap.clear();
+    set_perturbations.clear();
+    set_offsets.resize(1);
+    if (perturbations.empty() || set_num == 0)
+        return;
+
+    std::sort(perturbations.begin(), perturbations.end());
+    pushSet(perturbations[0].first * perturbations[0].first, 0, -1);
+
+    while (getSetNumber() < set_num && !heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater< std::pair<double, unsigned int> >());
+        std::pair<double, unsigned int> top = heap.back();
+        heap.pop_back();
+
+        unsigned int last = node_lasts[top.second];
+        if (last + 1 < perturbations.size()) {
+            double last_score = perturbations[last].first * perturbations[last].first;
+            double next_score = perturbations[last + 1].first * perturbations[last + 1].first;
+
+            // Shift, replace the last perturbation with the next one
+            pushSet(top.first - last_score + next_score, last + 1, node_parents[top.second]);
+            // Expand, add the next perturbation too
+            pushSet(top.first + next_score, last + 1, top.second);
+        }
+
+        // Follow the nodes back to the first perturbation of the set
+        current_set.clear();
+        for (int node = top.second; node != -1; node = node_parents[node])
+            current_set.emplace_back(node_lasts[node]);
+        std::reverse(current_set.begin(), current_set.end());
+
+        if (is_valid(current_set)) {
+            set_perturbations.insert(set_perturbations.end(), current_set.begin(), current_set.end());
+            set_offsets.emplace_back(set_perturbations.size());
+        }
+    }
+}
+
+
+inline unsigned int PerturbationBuffer::getPerturbationId(unsigned int sorted_i) const {
+    return perturbations[sorted_i].second;
+}
+
+
+inline unsigned int PerturbationBuffer::getSetNumber() const { return set_offsets.size() - 1; }
+
+
+inline const unsigned int* PerturbationBuffer::setBegin(unsigned int set_i) const {
+    return set_perturbations.data() + set_offsets[set_i];
+}
+
+
+inline const unsigned int* PerturbationBuffer::setEnd(unsigned int set_i) const {
+    return set_perturbations.data() + set_offsets[set_i + 1];
+}
+
+
+inline unsigned long PerturbationBuffer::getSize() {
+    unsigned long size = sizeof(*this);
+    size = size + perturbations.capacity()*sizeof(std::pair<double, unsigned int>);
+    size = size + node_lasts.capacity()*sizeof(unsigned int);
+    size = size + node_parents.capacity()*sizeof(int);
+    size = size + heap.capacity()*sizeof(std::pair<double, unsigned int>);
+    size = size + current_set.capacity()*sizeof(unsigned int);
+    size = size + set_perturbations.capacity()*sizeof(unsigned int);
+    size = size + set_offsets.capacity()*sizeof(unsigned int);
+
+    return size;
+}
+
+
+#endif //LIB_MULTI_PROBE_H
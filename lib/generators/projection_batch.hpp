@@ -0,0 +1,104 @@
+#ifndef LIB_PROJECTION_BATCH_H
+#define LIB_PROJECTION_BATCH_H
+
+#include <vector>
+
+#include "hash_generator.hpp"
+#include "../kernels/distance_kernels.hpp"
+
+/*
+ * Projection Batch
+ *
+ * Calculates the inner products that a group of hash generators need, for a block of vectors at once
+ *
+ * The projection vectors of all generators (eg. the k h functions of each of the L LSH hashtables) are stacked into
+ * one matrix, so the inner products of a whole block of vectors with all of them are a single matrix multiplication
+ * Each generator then turns its part of the inner products of a vector into its hash, with hashProjections
+ *
+ * The inner products are written into a buffer of the caller, so many threads can project their own blocks at once
+ *
+ * Templated, so that it can project any type of vector (int, float type dimensions)
+ */
+
+
+template <typename dim_type>
+class ProjectionBatch {
+private:
+    unsigned int dim_num;
+    unsigned int proj_num;
+
+    // Projection vectors of all generators, transposed (dim_num x proj_num)
+    std::vector<double> projections_t;
+    // Where the projections of each generator start
+    std::vector<unsigned int> generator_offsets;
+
+public:
+    ProjectionBatch(const std::vector< HashGenerator<dim_type>* >& generators, unsigned int in_dim_num);
+
+    // Calculate the inner products of a block of rows, each one with dim_num dimensions, with all projections
+    // The inner products are written into inner_products (row_num x proj_num)
+    void project(const dim_type* const* rows, unsigned int row_num, std::vector<double>* inner_products) const;
+
+    // Inner products of a row of a projected block that a generator needs, to pass to its hashProjections
+    const double* getInnerProducts(const std::vector<double>& inner_products, unsigned int row_i,
+                                   unsigned int generator_i) const;
+
+    unsigned int getProjectionNumber() const;
+
+    // Get size of object in bytes
+    unsigned long getSize();
+};
+
+
+/*
+* Template method definitions
+*/
+
+template <typename dim_type>
+ProjectionBatch<dim_type>::ProjectionBatch(const std::vector< HashGenerator<dim_type>* >& generators,
+                                           unsigned int in_dim_num) : dim_num(in_dim_num) {
+    // Gather the projections of all generators, one after the other
+    std::vector<double> projections;
+    for (auto generator : generators) {
+        generator_offsets.emplace_back(projections.size() / dim_num);
+        generator->getProjections(&projections);
+    }
+    proj_num = projections.size() / dim_num;
+
+    projections_t.resize(projections.size());
+    for (unsigned int proj_i = 0; proj_i < proj_num; proj_i++)
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++)
+            projections_t[dim_i * proj_num + proj_i] = projections[proj_i * dim_num + dim_i];
+}
+
+
+template <typename dim_type>
+void ProjectionBatch<dim_type>::project(const dim_type* const* rows, unsigned int row_num,
+                                        std::vector<double>* inner_products) const {
+    inner_products->resize(row_num * proj_num);
+    projection_kernel(rows, row_num, dim_num, projections_t.data(), proj_num, inner_products->data());
+}
+
+
+template <typename dim_type>
+const double* ProjectionBatch<dim_type>::getInnerProducts(const std::vector<double>& inner_products,
+                                                          unsigned int row_i, unsigned int generator_i) const {
+    return inner_products.data() + row_i * proj_num + generator_offsets[generator_i];
+}
+
+
+template <typename dim_type>
+unsigned int ProjectionBatch<dim_type>::getProjectionNumber() const { return proj_num; }
+
+
+template <typename dim_type>
+unsigned long ProjectionBatch<dim_type>::getSize() {
+    unsigned long size = sizeof(*this);
+    size = size + projections_t.capacity()*sizeof(double);
+    size = size + generator_offsets.capacity()*sizeof(unsigned int);
+
+    return size;
+}
+
+
+#endif //LIB_PROJECTION_BATCH_H
@@ -0,0 +1,527 @@
+#include <string>
+#include <vector>
+
+#include "distance_kernels.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISTANCE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/*
+ * Every instruction set implements the same six functions, they are kept in a table of function pointers
+ * which is filled once, the first time any kernel is called
+ */
+
+struct KernelTable {
+    string isa;
+    double (*dot_d)(const double*, const double*, unsigned int);
+    float (*dot_f)(const float*, const float*, unsigned int);
+    double (*squared_l2_d)(const double*, const double*, unsigned int);
+    float (*squared_l2_f)(const float*, const float*, unsigned int);
+    void (*dot_norms_d)(const double*, const double*, unsigned int, double*, double*, double*);
+    void (*dot_norms_f)(const float*, const float*, unsigned int, double*, double*, double*);
+};
+
+
+/*
+ * Scalar implementations, with the same accumulator types as the SIMD ones
+ */
+
+static double scalar_dot_d(const double* a, const double* b, unsigned int n) { return scalar_dot(a, b, n); }
+
+static float scalar_dot_f(const float* a, const float* b, unsigned int n) {
+    float accum = 0;
+    for (unsigned int i = 0; i < n; i++)
+        accum = accum + a[i] * b[i];
+    return accum;
+}
+
+static double scalar_squared_l2_d(const double* a, const double* b, unsigned int n) { return scalar_squared_l2(a, b, n); }
+
+static float scalar_squared_l2_f(const float* a, const float* b, unsigned int n) {
+    float accum = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        float diff = a[i] - b[i];
+        accum = accum + diff * diff;
+    }
+    return accum;
+}
+
+static void scalar_dot_norms_d(const double* a, const double* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    scalar_dot_norms(a, b, n, dot, a_norm, b_norm);
+}
+
+static void scalar_dot_norms_f(const float* a, const float* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    float dot_accum = 0;
+    float a_accum = 0;
+    float b_accum = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        dot_accum = dot_accum + a[i] * b[i];
+        a_accum = a_accum + a[i] * a[i];
+        b_accum = b_accum + b[i] * b[i];
+    }
+    *dot = dot_accum;
+    *a_norm = a_accum;
+    *b_norm = b_accum;
+}
+
+
+#ifdef DISTANCE_KERNELS_X86
+
+/*
+ * SSE2 implementations, 2 doubles or 4 floats per instruction
+ */
+
+__attribute__((target("sse2")))
+static double sum_m128d(__m128d v) {
+    double lanes[2];
+    _mm_storeu_pd(lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2")))
+static float sum_m128(__m128 v) {
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("sse2")))
+static double sse2_dot_d(const double* a, const double* b, unsigned int n) {
+    __m128d accum = _mm_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2)
+        accum = _mm_add_pd(accum, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+
+    double result = sum_m128d(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("sse2")))
+static float sse2_dot_f(const float* a, const float* b, unsigned int n) {
+    __m128 accum = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+    float result = sum_m128(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("sse2")))
+static double sse2_squared_l2_d(const double* a, const double* b, unsigned int n) {
+    __m128d accum = _mm_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d diff = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        accum = _mm_add_pd(accum, _mm_mul_pd(diff, diff));
+    }
+
+    double result = sum_m128d(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("sse2")))
+static float sse2_squared_l2_f(const float* a, const float* b, unsigned int n) {
+    __m128 accum = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        accum = _mm_add_ps(accum, _mm_mul_ps(diff, diff));
+    }
+
+    float result = sum_m128(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("sse2")))
+static void sse2_dot_norms_d(const double* a, const double* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m128d dot_accum = _mm_setzero_pd();
+    __m128d a_accum = _mm_setzero_pd();
+    __m128d b_accum = _mm_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d a_v = _mm_loadu_pd(a + i);
+        __m128d b_v = _mm_loadu_pd(b + i);
+        dot_accum = _mm_add_pd(dot_accum, _mm_mul_pd(a_v, b_v));
+        a_accum = _mm_add_pd(a_accum, _mm_mul_pd(a_v, a_v));
+        b_accum = _mm_add_pd(b_accum, _mm_mul_pd(b_v, b_v));
+    }
+
+    *dot = sum_m128d(dot_accum);
+    *a_norm = sum_m128d(a_accum);
+    *b_norm = sum_m128d(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+__attribute__((target("sse2")))
+static void sse2_dot_norms_f(const float* a, const float* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m128 dot_accum = _mm_setzero_ps();
+    __m128 a_accum = _mm_setzero_ps();
+    __m128 b_accum = _mm_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 a_v = _mm_loadu_ps(a + i);
+        __m128 b_v = _mm_loadu_ps(b + i);
+        dot_accum = _mm_add_ps(dot_accum, _mm_mul_ps(a_v, b_v));
+        a_accum = _mm_add_ps(a_accum, _mm_mul_ps(a_v, a_v));
+        b_accum = _mm_add_ps(b_accum, _mm_mul_ps(b_v, b_v));
+    }
+
+    *dot = sum_m128(dot_accum);
+    *a_norm = sum_m128(a_accum);
+    *b_norm = sum_m128(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+
+/*
+ * AVX2 implementations, 4 doubles or 8 floats per instruction, using fused multiply-add
+ */
+
+__attribute__((target("avx2,fma")))
+static double sum_m256d(__m256d v) {
+    __m128d low = _mm256_castpd256_pd128(v);
+    __m128d high = _mm256_extractf128_pd(v, 1);
+    __m128d sum = _mm_add_pd(low, high);
+    return _mm_cvtsd_f64( _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)) );
+}
+
+__attribute__((target("avx2,fma")))
+static float sum_m256(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static double avx2_dot_d(const double* a, const double* b, unsigned int n) {
+    __m256d accum = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4)
+        accum = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), accum);
+
+    double result = sum_m256d(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_dot_f(const float* a, const float* b, unsigned int n) {
+    __m256 accum = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8)
+        accum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), accum);
+
+    float result = sum_m256(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static double avx2_squared_l2_d(const double* a, const double* b, unsigned int n) {
+    __m256d accum = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        accum = _mm256_fmadd_pd(diff, diff, accum);
+    }
+
+    double result = sum_m256d(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2_squared_l2_f(const float* a, const float* b, unsigned int n) {
+    __m256 accum = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        accum = _mm256_fmadd_ps(diff, diff, accum);
+    }
+
+    float result = sum_m256(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_dot_norms_d(const double* a, const double* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m256d dot_accum = _mm256_setzero_pd();
+    __m256d a_accum = _mm256_setzero_pd();
+    __m256d b_accum = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d a_v = _mm256_loadu_pd(a + i);
+        __m256d b_v = _mm256_loadu_pd(b + i);
+        dot_accum = _mm256_fmadd_pd(a_v, b_v, dot_accum);
+        a_accum = _mm256_fmadd_pd(a_v, a_v, a_accum);
+        b_accum = _mm256_fmadd_pd(b_v, b_v, b_accum);
+    }
+
+    *dot = sum_m256d(dot_accum);
+    *a_norm = sum_m256d(a_accum);
+    *b_norm = sum_m256d(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2_dot_norms_f(const float* a, const float* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m256 dot_accum = _mm256_setzero_ps();
+    __m256 a_accum = _mm256_setzero_ps();
+    __m256 b_accum = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 a_v = _mm256_loadu_ps(a + i);
+        __m256 b_v = _mm256_loadu_ps(b + i);
+        dot_accum = _mm256_fmadd_ps(a_v, b_v, dot_accum);
+        a_accum = _mm256_fmadd_ps(a_v, a_v, a_accum);
+        b_accum = _mm256_fmadd_ps(b_v, b_v, b_accum);
+    }
+
+    *dot = sum_m256(dot_accum);
+    *a_norm = sum_m256(a_accum);
+    *b_norm = sum_m256(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+
+/*
+ * AVX-512 implementations, 8 doubles or 16 floats per instruction
+ */
+
+__attribute__((target("avx512f")))
+static double avx512_dot_d(const double* a, const double* b, unsigned int n) {
+    __m512d accum = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8)
+        accum = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), accum);
+
+    double result = _mm512_reduce_add_pd(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static float avx512_dot_f(const float* a, const float* b, unsigned int n) {
+    __m512 accum = _mm512_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16)
+        accum = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), accum);
+
+    float result = _mm512_reduce_add_ps(accum);
+    for (; i < n; i++)
+        result = result + a[i] * b[i];
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static double avx512_squared_l2_d(const double* a, const double* b, unsigned int n) {
+    __m512d accum = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+        accum = _mm512_fmadd_pd(diff, diff, accum);
+    }
+
+    double result = _mm512_reduce_add_pd(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static float avx512_squared_l2_f(const float* a, const float* b, unsigned int n) {
+    __m512 accum = _mm512_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        accum = _mm512_fmadd_ps(diff, diff, accum);
+    }
+
+    float result = _mm512_reduce_add_ps(accum);
+    for (; i < n; i++)
+        result = result + (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static void avx512_dot_norms_d(const double* a, const double* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m512d dot_accum = _mm512_setzero_pd();
+    __m512d a_accum = _mm512_setzero_pd();
+    __m512d b_accum = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d a_v = _mm512_loadu_pd(a + i);
+        __m512d b_v = _mm512_loadu_pd(b + i);
+        dot_accum = _mm512_fmadd_pd(a_v, b_v, dot_accum);
+        a_accum = _mm512_fmadd_pd(a_v, a_v, a_accum);
+        b_accum = _mm512_fmadd_pd(b_v, b_v, b_accum);
+    }
+
+    *dot = _mm512_reduce_add_pd(dot_accum);
+    *a_norm = _mm512_reduce_add_pd(a_accum);
+    *b_norm = _mm512_reduce_add_pd(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512_dot_norms_f(const float* a, const float* b, unsigned int n, double* dot, double* a_norm,
+        double* b_norm) {
+    __m512 dot_accum = _mm512_setzero_ps();
+    __m512 a_accum = _mm512_setzero_ps();
+    __m512 b_accum = _mm512_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 a_v = _mm512_loadu_ps(a + i);
+        __m512 b_v = _mm512_loadu_ps(b + i);
+        dot_accum = _mm512_fmadd_ps(a_v, b_v, dot_accum);
+        a_accum = _mm512_fmadd_ps(a_v, a_v, a_accum);
+        b_accum = _mm512_fmadd_ps(b_v, b_v, b_accum);
+    }
+
+    *dot = _mm512_reduce_add_ps(dot_accum);
+    *a_norm = _mm512_reduce_add_ps(a_accum);
+    *b_norm = _mm512_reduce_add_ps(b_accum);
+    for (; i < n; i++) {
+        *dot = *dot + a[i] * b[i];
+        *a_norm = *a_norm + a[i] * a[i];
+        *b_norm = *b_norm + b[i] * b[i];
+    }
+}
+
+#endif //DISTANCE_KERNELS_X86
+
+
+/*
+ * Runtime dispatch
+ */
+
+static bool make_kernel_table(const string& isa, KernelTable* table) {
+    if (isa == "scalar") {
+        *table = {isa, scalar_dot_d, scalar_dot_f, scalar_squared_l2_d, scalar_squared_l2_f, scalar_dot_norms_d,
+                  scalar_dot_norms_f};
+        return true;
+    }
+
+#ifdef DISTANCE_KERNELS_X86
+    __builtin_cpu_init();
+    if (isa == "avx512" && __builtin_cpu_supports("avx512f")) {
+        *table = {isa, avx512_dot_d, avx512_dot_f, avx512_squared_l2_d, avx512_squared_l2_f, avx512_dot_norms_d,
+                  avx512_dot_norms_f};
+        return true;
+    }
+    if (isa == "avx2" && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *table = {isa, avx2_dot_d, avx2_dot_f, avx2_squared_l2_d, avx2_squared_l2_f, avx2_dot_norms_d,
+                  avx2_dot_norms_f};
+        return true;
+    }
+    if (isa == "sse2" && __builtin_cpu_supports("sse2")) {
+        *table = {isa, sse2_dot_d, sse2_dot_f, sse2_squared_l2_d, sse2_squared_l2_f, sse2_dot_norms_d,
+                  sse2_dot_norms_f};
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+
+static KernelTable& kernel_table() {
+    static KernelTable table = []() {
+        KernelTable best;
+        make_kernel_table(get_supported_kernel_isas()[0], &best);
+        return best;
+    }();
+
+    return table;
+}
+
+
+vector<string> get_supported_kernel_isas() {
+    vector<string> isas;
+    KernelTable temp;
+    for (const char* isa : {"avx512", "avx2", "sse2", "scalar"}) {
+        if (make_kernel_table(isa, &temp))
+            isas.emplace_back(isa);
+    }
+
+    return isas;
+}
+
+
+string get_kernel_isa() { return kernel_table().isa; }
+
+
+bool set_kernel_isa(const string& isa) { return make_kernel_table(isa, &kernel_table()); }
+
+
+double dot_kernel(const double* a, const double* b, unsigned int n) { return kernel_table().dot_d(a, b, n); }
+
+
+float dot_kernel(const float* a, const float* b, unsigned int n) { return kernel_table().dot_f(a, b, n); }
+
+
+double squared_l2_kernel(const double* a, const double* b, unsigned int n) {
+    return kernel_table().squared_l2_d(a, b, n);
+}
+
+
+float squared_l2_kernel(const float* a, const float* b, unsigned int n) {
+    return kernel_table().squared_l2_f(a, b, n);
+}
+
+
+void dot_norms_kernel(const double* a, const double* b, unsigned int n, double* dot, double* a_norm, double* b_norm) {
+    kernel_table().dot_norms_d(a, b, n, dot, a_norm, b_norm);
+}
+
+
+void dot_norms_kernel(const float* a, const float* b, unsigned int n, double* dot, double* a_norm, double* b_norm) {
+    kernel_table().dot_norms_f(a, b, n, dot, a_norm, b_norm);
+}
@@ -0,0 +1,173 @@
+#ifndef LIB_DISTANCE_KERNELS_H
+#define LIB_DISTANCE_KERNELS_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Distance Kernels
+ *
+ * Low level loops that every vector operation of this project ends up in (inner product, squared euclidean distance
+ * and inner product together with both squared norms for cosine), working on raw arrays of dimensions
+ *
+ * For double and float arrays the work is done by SIMD implementations (AVX-512, AVX2 with FMA or SSE2), the best of
+ * which is chosen at runtime according to what the CPU supports
+ * Any other combination of types falls back to the scalar reference implementations, which are also kept so that
+ * the SIMD versions can be tested against them
+ *
+ * The projection kernel multiplies a block of rows with a matrix of projection vectors (a small GEMM), used to hash
+ * many vectors at once
+ */
+
+
+// Inner product of two arrays with n elements
+double dot_kernel(const double* a, const double* b, unsigned int n);
+float dot_kernel(const float* a, const float* b, unsigned int n);
+
+// Squared euclidean distance of two arrays with n elements
+double squared_l2_kernel(const double* a, const double* b, unsigned int n);
+float squared_l2_kernel(const float* a, const float* b, unsigned int n);
+
+// Inner product of two arrays and the squared norm of each one, in a single pass
+// Results are always returned as doubles, so that callers do not depend on the dimension type
+void dot_norms_kernel(const double* a, const double* b, unsigned int n, double* dot, double* a_norm, double* b_norm);
+void dot_norms_kernel(const float* a, const float* b, unsigned int n, double* dot, double* a_norm, double* b_norm);
+
+// Name of the instruction set currently used by the kernels ("avx512", "avx2", "sse2" or "scalar")
+std::string get_kernel_isa();
+
+// Names of all instruction sets that this CPU can run, best first
+std::vector<std::string> get_supported_kernel_isas();
+
+// Force the kernels to use a specific instruction set, returns false if the CPU does not support it
+// The kernels are switched without any locking, so this must not be called while other threads use them
+bool set_kernel_isa(const std::string& isa);
+
+// Scalar reference implementations, for any dimension types
+template <typename a_type, typename b_type>
+double scalar_dot(const a_type* a, const b_type* b, unsigned int n);
+
+template <typename a_type, typename b_type>
+double scalar_squared_l2(const a_type* a, const b_type* b, unsigned int n);
+
+template <typename a_type, typename b_type>
+void scalar_dot_norms(const a_type* a, const b_type* b, unsigned int n, double* dot, double* a_norm, double* b_norm);
+
+// Inner products of row_num rows of dim_num dimensions with proj_num projection vectors, written row by row into
+// inner_products (row_num x proj_num)
+// The projections are given transposed (dim_num x proj_num), so the innermost loop runs over contiguous projections
+// Every inner product is summed in the order of the dimensions, so it does not depend on how many rows or projections
+// are in the block
+template <typename row_type>
+void projection_kernel(const row_type* const* rows, unsigned int row_num, unsigned int dim_num,
+                       const double* projections_t, unsigned int proj_num, double* inner_products);
+
+// Fallbacks for type combinations that have no SIMD implementation (eg. int vectors, or float with double)
+template <typename a_type, typename b_type>
+double dot_kernel(const a_type* a, const b_type* b, unsigned int n);
+
+template <typename a_type, typename b_type>
+double squared_l2_kernel(const a_type* a, const b_type* b, unsigned int n);
+
+template <typename a_type, typename b_type>
+void dot_norms_kernel(const a_type* a, const b_type* b, unsigned int n, double* dot, double* a_norm, double* b_norm);
+
+
+/*
+* Template function definitions
+*/
+
+
+template <typename a_type, typename b_type>
+double scalar_dot(const a_type* a, const b_type* b, unsigned int n) {
+    double accum = 0;
+    for (unsigned int i = 0; i < n; i++)
+        accum = accum + double(a[i]) * double(b[i]);
+
+    return accum;
+}
+
+
+template <typename a_type, typename b_type>
+double scalar_squared_l2(const a_type* a, const b_type* b, unsigned int n) {
+    double accum = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        double diff = double(a[i]) - double(b[i]);
+        accum = accum + diff * diff;
+    }
+
+    return accum;
+}
+
+
+template <typename a_type, typename b_type>
+void scalar_dot_norms(const a_type* a, const b_type* b, unsigned int n, double* dot, double* a_norm, double* b_norm) {
+    double dot_accum = 0;
+    double a_accum = 0;
+    double b_accum = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        dot_accum = dot_accum + double(a[i]) * double(b[i]);
+        a_accum = a_accum + double(a[i]) * double(a[i]);
+        b_accum = b_accum + double(b[i]) * double(b[i]);
+    }
+
+    *dot = dot_accum;
+    *a_norm = a_accum;
+    *b_norm = b_accum;
+}
+
+
+template <typename row_type>
+void projection_kernel(const row_type* const* rows, unsigned int row_num, unsigned int dim_num,
+                       const double* projections_t, unsigned int proj_num, double* inner_products) {
+    for (unsigned int i = 0; i < row_num * proj_num; i++)
+        inner_products[i] = 0;
+
+    // Four rows at a time, so that each projection row loaded is used four times
+    unsigned int row_i = 0;
+    for (; row_i + 4 <= row_num; row_i = row_i + 4) {
+        double* out0 = inner_products + row_i * proj_num;
+        double* out1 = out0 + proj_num;
+        double* out2 = out1 + proj_num;
+        double* out3 = out2 + proj_num;
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++) {
+            double x0 = double(rows[row_i][dim_i]);
+            double x1 = double(rows[row_i + 1][dim_i]);
+            double x2 = double(rows[row_i + 2][dim_i]);
+            double x3 = double(rows[row_i + 3][dim_i]);
+            const double* proj_row = projections_t + dim_i * proj_num;
+            for (unsigned int proj_i = 0; proj_i < proj_num; proj_i++) {
+                out0[proj_i] = out0[proj_i] + x0 * proj_row[proj_i];
+                out1[proj_i] = out1[proj_i] + x1 * proj_row[proj_i];
+                out2[proj_i] = out2[proj_i] + x2 * proj_row[proj_i];
+                out3[proj_i] = out3[proj_i] + x3 * proj_row[proj_i];
+            }
+        }
+    }
+    for (; row_i < row_num; row_i++) {
+        double* out = inner_products + row_i * proj_num;
+        for (unsigned int dim_i = 0; dim_i < dim_num; dim_i++) {
+            double x = double(rows[row_i][dim_i]);
+            const double* proj_row = projections_t + dim_i * proj_num;
+            for (unsigned int proj_i = 0; proj_i < proj_num; proj_i++)
+                out[proj_i] = out[proj_i] + x * proj_row[proj_i];
+        }
+    }
+}
+
+
+template <typename a_type, typename b_type>
+double dot_kernel(const a_type* a, const b_type* b, unsigned int n) { return scalar_dot(a, b, n); }
+
+
+template <typename a_type, typename b_type>
+double squared_l2_kernel(const a_type* a, const b_type* b, unsigned int n) { return scalar_squared_l2(a, b, n); }
+
+
+template <typename a_type, typename b_type>
+void dot_norms_kernel(const a_type* a, const b_type* b, unsigned int n, double* dot, double* a_norm, double* b_norm) {
+    scalar_dot_norms(a, b, n, dot, a_norm, b_norm);
+}
+
+
+#endif //LIB_DISTANCE_KERNELS_H
@@ -3,17 +3,20 @@
 
 #include <iostream>
 #include <string>
-#include <set>
+#include <algorithm>
+#include <cstdint>
 
-#include <chrono>
 #include <random>
 
 #include "./data_structures/cust_vector.hpp"
 #include "./data_structures/cust_hashtable.hpp"
+#include "./data_structures/candidate_set.h"
 #include "./generators/euclidean_phi_gen.hpp"
 #include "./generators/cosine_g_gen.hpp"
 #include "./generators/euclidean_f_gen.hpp"
 #include "./generators/hypercube_gen.hpp"
+#include "./generators/projection_batch.hpp"
+#include "./parallel/thread_pool.h"
 
 #include "utils.hpp"
 
@@ -22,70 +25,243 @@
  * aggregated here so that they can be freely used for clustering in this project
  *
  * All functions are templated, so they can be used for any kind of input vector type
+ *
+ * The hashtables are built in parallel, each LSH hashtable draws its hash functions from its own random stream, so
+ * they can be created in any order, and the same seed always gives the same hashtables
  */
 
 
+// Number of vectors hashed together by a single matrix multiplication with the projections of all hashtables
+const unsigned int HASH_BLOCK_ROWS = 64;
+
 template <typename vector_type>
 std::vector< CustHashtable<vector_type>* > create_LSH_hashtables(std::vector< CustVector<vector_type> >& input_vectors,
-        std::string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w);
+        std::string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w, unsigned long seed,
+        ThreadPool& pool);
+
+// Create L empty LSH hashtables at once, hashtable i with a random generator seeded from seed and i
+template <typename vector_type>
+std::vector< CustHashtable<vector_type>* > create_empty_LSH_hashtables(std::string metric_type, int k, int L,
+        int dim_num, int vector_num, int lsh_bucket_div, double euclidean_h_w, unsigned long seed, ThreadPool& pool);
+
+// Insert all input vectors in all hashtables, hashing blocks of HASH_BLOCK_ROWS vectors at once
+// The inner products of each block with the projections of all hashtables are a single ProjectionBatch, and the
+// blocks are hashed in parallel, each into its own slots of the hashtables
+template <typename vector_type>
+void insert_hashed_blocks(std::vector< CustHashtable<vector_type>* >& hashtables,
+        std::vector< CustVector<vector_type> >& input_vectors, ThreadPool& pool);
+
+// Build the buckets of all hashtables, a whole hashtable per task if there are enough of them for the threads of the
+// pool, else one hashtable after the other, each with parallel count and scatter passes
+template <typename vector_type>
+void build_all_buckets(std::vector< CustHashtable<vector_type>* >& hashtables, ThreadPool& pool);
+
+// Create one empty LSH hashtable, with the hash generator that corresponds to the input metric
+template <typename vector_type>
+CustHashtable<vector_type>* create_LSH_hashtable(std::string metric_type, int k, int dim_num, int vector_num,
+        int lsh_bucket_div, double euclidean_h_w, std::default_random_engine* rand_generator);
+
+// Collect the different vectors in the buckets of the query vector of all lsh hashtables into the candidate set, as
+// their slot indexes, which are their indexes in the input vectors the hashtables were created from
+// The candidates are kept in the order they were first found, and their number is returned
+// The hashtables are looked up in order, so with a capped candidate set, the collection stops as soon as the cap is
+// reached, and the same query always keeps the same candidates
+template <typename vector_type>
+unsigned int collect_LSH_candidates(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, CandidateSet& candidates);
+
+// Same as above, but from the filtered buckets of the query
+// With more than one probe, probe_num filtered buckets are looked up in each hashtable instead of one, the bucket of
+// the query and the ones its neighbors are most likely to be in, so fewer hashtables give as many candidates
+// Each hashtable is probed in order of the probe scores, after the hashtables before it
+// The probes are looked up with a probe buffer that, like the candidate set, is reused between queries
+template <typename vector_type>
+unsigned int collect_LSH_filtered_candidates(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, unsigned int probe_num, CandidateSet& candidates,
+        ProbeBuffer<vector_type>& probes);
 
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > get_LSH_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
         CustVector<vector_type>* queryVec);
 
+// Same as above, with a candidate set that is reused between queries
+template <typename vector_type>
+std::vector< CustVector<vector_type>* > get_LSH_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, CandidateSet& candidates);
+
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > get_LSH_filtered_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
         CustVector<vector_type>* queryVec);
 
+// Same as above, but with probe_num probes per hashtable, and the different vectors are written into an output vector
+// that, like the candidate set and the probe buffer, can be reused between queries, so that once they have grown
+// enough, a query allocates nothing
+template <typename vector_type>
+void get_LSH_filtered_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, unsigned int probe_num, CandidateSet& candidates,
+        ProbeBuffer<vector_type>& probes, std::vector< CustVector<vector_type>* >& output);
+
 /*
 * Function definitions
 */
 
 template <typename vector_type>
 std::vector< CustHashtable<vector_type>* > create_LSH_hashtables(std::vector< CustVector<vector_type> >& input_vectors,
-        const std::string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w) {
+        const std::string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w, unsigned long seed,
+        ThreadPool& pool) {
 
     // Create L Hashtables and insert those vectors in them using H
-    unsigned long seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rand_generator;
-    rand_generator.seed(seed);
-
-    std::vector< CustHashtable<vector_type>* > lshHashtables;
-    lshHashtables.reserve(L);
-    for (int i = 0; i < L; i++) {
-        // If the chosen metric is euclidean, then create an EuclideanPhiGen hash generator
-        // and pass in to the hashtable constructor
-        if (metric_type == "euclidean") {
-            EuclideanPhiGen<vector_type>* generator = new EuclideanPhiGen<vector_type>(k, input_vectors[0].getDimNumber(), euclidean_h_w, &rand_generator);
-            lshHashtables.emplace_back(new CustHashtable<vector_type>(generator, input_vectors.size() / lsh_bucket_div));
-        }
-        // Else create a CosineGGen hash generator
-        else if (metric_type == "cosine") {
-            CosineGGen<vector_type>* generator = new CosineGGen<vector_type>(k, input_vectors[0].getDimNumber(), &rand_generator);
-            int bucket_num = int( pow(2, k) );
-            lshHashtables.emplace_back( new CustHashtable<vector_type>(generator, bucket_num));
+    std::vector< CustHashtable<vector_type>* > lshHashtables = create_empty_LSH_hashtables<vector_type>(metric_type, k,
+            L, input_vectors[0].getDimNumber(), input_vectors.size(), lsh_bucket_div, euclidean_h_w, seed, pool);
+
+    // Insert all read vectors into all the LSH hashtables at once
+    insert_hashed_blocks(lshHashtables, input_vectors, pool);
+    build_all_buckets(lshHashtables, pool);
+
+    return lshHashtables;
+}
+
+
+template <typename vector_type>
+std::vector< CustHashtable<vector_type>* > create_empty_LSH_hashtables(const std::string metric_type, int k, int L,
+        int dim_num, int vector_num, int lsh_bucket_div, double euclidean_h_w, unsigned long seed, ThreadPool& pool) {
+    std::vector< CustHashtable<vector_type>* > lshHashtables(L, nullptr);
+    pool.parallelFor(L, [&](unsigned int table_i) {
+        // seed_seq keeps only the lower 32 bits of each value, so the seed is given in two halves
+        std::seed_seq table_seed{ uint32_t(seed), uint32_t(seed >> 32), uint32_t(table_i) };
+        std::default_random_engine rand_generator(table_seed);
+
+        lshHashtables[table_i] = create_LSH_hashtable<vector_type>(metric_type, k, dim_num, vector_num, lsh_bucket_div,
+                euclidean_h_w, &rand_generator);
+    });
+
+    return lshHashtables;
+}
+
+
+template <typename vector_type>
+void insert_hashed_blocks(std::vector< CustHashtable<vector_type>* >& hashtables,
+        std::vector< CustVector<vector_type> >& input_vectors, ThreadPool& pool) {
+    std::vector< HashGenerator<vector_type>* > generators;
+    std::vector<unsigned int> first_slots;
+    for (auto hashtable : hashtables) {
+        generators.emplace_back( hashtable->getHashGenerator() );
+        first_slots.emplace_back( hashtable->addVectorSlots(input_vectors.size()) );
+    }
+    ProjectionBatch<vector_type> batch(generators, input_vectors[0].getDimNumber());
+
+    unsigned int block_num = (input_vectors.size() + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS;
+    pool.parallelFor(block_num, [&](unsigned int block_i) {
+        unsigned int block_start = block_i * HASH_BLOCK_ROWS;
+        unsigned int block_size = std::min(HASH_BLOCK_ROWS, (unsigned int) input_vectors.size() - block_start);
+
+        const vector_type* block_rows[HASH_BLOCK_ROWS];
+        for (unsigned int row_i = 0; row_i < block_size; row_i++)
+            block_rows[row_i] = input_vectors[block_start + row_i].getDimensions()->data();
+        std::vector<double> inner_products;
+        batch.project(block_rows, block_size, &inner_products);
+
+        for (unsigned int row_i = 0; row_i < block_size; row_i++)
+            for (unsigned int table_i = 0; table_i < hashtables.size(); table_i++)
+                hashtables[table_i]->setVectorSlot(first_slots[table_i] + block_start + row_i,
+                        &input_vectors[block_start + row_i], batch.getInnerProducts(inner_products, row_i, table_i));
+    });
+}
+
+
+template <typename vector_type>
+void build_all_buckets(std::vector< CustHashtable<vector_type>* >& hashtables, ThreadPool& pool) {
+    if (hashtables.size() >= pool.getThreadNum()) {
+        pool.parallelFor(hashtables.size(), [&](unsigned int table_i) { hashtables[table_i]->buildBuckets(); });
+    }
+    else {
+        for (auto hashtable : hashtables)
+            hashtable->buildBuckets(pool);
+    }
+}
+
+
+template <typename vector_type>
+CustHashtable<vector_type>* create_LSH_hashtable(const std::string metric_type, int k, int dim_num, int vector_num,
+        int lsh_bucket_div, double euclidean_h_w, std::default_random_engine* rand_generator) {
+    // If the chosen metric is euclidean, then create an EuclideanPhiGen hash generator
+    // and pass in to the hashtable constructor
+    if (metric_type == "euclidean") {
+        EuclideanPhiGen<vector_type>* generator = new EuclideanPhiGen<vector_type>(k, dim_num, euclidean_h_w, rand_generator);
+        return new CustHashtable<vector_type>(generator, vector_num / lsh_bucket_div);
+    }
+    // Else create a CosineGGen hash generator
+    else if (metric_type == "cosine") {
+        CosineGGen<vector_type>* generator = new CosineGGen<vector_type>(k, dim_num, rand_generator);
+        int bucket_num = int( pow(2, k) );
+        return new CustHashtable<vector_type>(generator, bucket_num);
+    }
+
+    return nullptr;
+}
+
+
+template <typename vector_type>
+unsigned int collect_LSH_candidates(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, CandidateSet& candidates) {
+    candidates.clear();
+    for (int i = 0; i < lshHashtables.size() && !candidates.isCapped(); i++) {
+        BucketView<vector_type> bucket = lshHashtables[i]->viewBucketFor(queryVec);
+        for (auto it = bucket.begin(); it != bucket.end() && !candidates.isCapped(); ++it)
+            candidates.insert(it.getSlot());
+    }
+
+    return candidates.getCandidateNumber();
+}
+
+
+template <typename vector_type>
+unsigned int collect_LSH_filtered_candidates(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, unsigned int probe_num, CandidateSet& candidates,
+        ProbeBuffer<vector_type>& probes) {
+    candidates.clear();
+    if (probe_num <= 1) {
+        for (int i = 0; i < lshHashtables.size() && !candidates.isCapped(); i++) {
+            FilteredBucketView<vector_type> filtered_bucket = lshHashtables[i]->viewFilteredBucketFor(queryVec);
+            for (auto it = filtered_bucket.begin(); it != filtered_bucket.end() && !candidates.isCapped(); ++it)
+                candidates.insert(it.getSlot());
         }
-        // Insert all read vectors into the new LSH hashtable
-        for (int vec_i = 0; vec_i < input_vectors.size(); vec_i++)
-            lshHashtables[i]->insertVector(&input_vectors[vec_i]);
+
+        return candidates.getCandidateNumber();
     }
 
-    return lshHashtables;
+    for (int i = 0; i < lshHashtables.size() && !candidates.isCapped(); i++) {
+        lshHashtables[i]->viewFilteredProbesFor(queryVec, probe_num, &probes);
+        for (auto& probe_view : probes.getViews())
+            for (auto it = probe_view.begin(); it != probe_view.end() && !candidates.isCapped(); ++it)
+                candidates.insert(it.getSlot());
+    }
+
+    return candidates.getCandidateNumber();
 }
 
 
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > get_LSH_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
         CustVector<vector_type>* queryVec) {
-    std::set< CustVector<vector_type>* > buckets;
-    // Put all different vectors of chosen bucket for each lsh hashtable into a set
-    for (int i = 0; i < lshHashtables.size(); i++) {
-        std::vector< CustVector<vector_type>* > filtered_bucket = lshHashtables[i]->getBucketFor(queryVec);
-        std::copy( filtered_bucket.begin(), filtered_bucket.end(), std::inserter( buckets, buckets.end() ) );
-    }
+    if (lshHashtables.empty())
+        return std::vector< CustVector<vector_type>* >();
+
+    CandidateSet candidates(lshHashtables[0]->getSlotNumber());
+    return get_LSH_combined_buckets(lshHashtables, queryVec, candidates);
+}
+
+
+template <typename vector_type>
+std::vector< CustVector<vector_type>* > get_LSH_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, CandidateSet& candidates) {
+    std::vector< CustVector<vector_type>* > output;
+    collect_LSH_candidates(lshHashtables, queryVec, candidates);
+
+    output.reserve(candidates.getCandidateNumber());
+    for (uint32_t slot_i : candidates.getCandidates())
+        output.emplace_back(lshHashtables[0]->getSlotVector(slot_i));
 
-    // Convert set to vector and return
-    std::vector< CustVector<vector_type>* > output(buckets.begin(), buckets.end());
     return output;
 }
 
@@ -93,25 +269,35 @@ std::vector< CustVector<vector_type>* > get_LSH_combined_buckets(std::vector< Cu
 template <typename vector_type>
 std::vector< CustVector<vector_type>* > get_LSH_filtered_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
                                                                  CustVector<vector_type>* queryVec) {
-    std::set< CustVector<vector_type>* > buckets;
-    // Put all different vectors of chosen bucket for each lsh hashtable into a set
-    for (int i = 0; i < lshHashtables.size(); i++) {
-        std::vector< CustVector<vector_type>* > filtered_bucket = lshHashtables[i]->getFilteredBucketFor(queryVec);
-        std::copy( filtered_bucket.begin(), filtered_bucket.end(), std::inserter( buckets, buckets.end() ) );
-    }
+    std::vector< CustVector<vector_type>* > output;
+    if (lshHashtables.empty())
+        return output;
+
+    CandidateSet candidates(lshHashtables[0]->getSlotNumber());
+    ProbeBuffer<vector_type> probes;
+    get_LSH_filtered_combined_buckets(lshHashtables, queryVec, 1, candidates, probes, output);
 
-    // Convert set to vector and return
-    std::vector< CustVector<vector_type>* > output(buckets.begin(), buckets.end());
     return output;
 }
 
+
+template <typename vector_type>
+void get_LSH_filtered_combined_buckets(std::vector< CustHashtable<vector_type>* >& lshHashtables,
+        CustVector<vector_type>* queryVec, unsigned int probe_num, CandidateSet& candidates,
+        ProbeBuffer<vector_type>& probes, std::vector< CustVector<vector_type>* >& output) {
+    output.clear();
+    collect_LSH_filtered_candidates(lshHashtables, queryVec, probe_num, candidates, probes);
+
+    // Every hashtable has the same vector in the same slot, so any of them can map the slots back to vectors
+    for (uint32_t slot_i : candidates.getCandidates())
+        output.emplace_back(lshHashtables[0]->getSlotVector(slot_i));
+}
+
 template <typename vector_type>
 CustHashtable<vector_type>* create_hypercube(std::vector< CustVector<vector_type> >& input_vectors,
-        const std::string metric_type, int k, double euclidean_h_w) {
+        const std::string metric_type, int k, double euclidean_h_w, unsigned long seed, ThreadPool& pool) {
 
-    unsigned long seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rand_generator;
-    rand_generator.seed(seed);
+    std::default_random_engine rand_generator(seed);
 
     std::vector< HashGenerator<vector_type>* > generators;
     // If the chosen metric is euclidean, then create EuclideanFGen hash generators to pass to HypercubeGen constructor
@@ -129,8 +315,9 @@ CustHashtable<vector_type>* create_hypercube(std::vector< CustVector<vector_type
     CustHashtable<vector_type>* hypercube = new CustHashtable<vector_type>(new HypercubeGen<vector_type>(generators), bucket_num);
 
     // Insert all read vectors into the Hypercube
-    for (int vec_i = 0; vec_i < input_vectors.size(); vec_i++)
-        hypercube->insertVector(&input_vectors[vec_i]);
+    std::vector< CustHashtable<vector_type>* > hashtables(1, hypercube);
+    insert_hashed_blocks(hashtables, input_vectors, pool);
+    hypercube->buildBuckets(pool);
 
     return hypercube;
 }
@@ -0,0 +1,100 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int thread_num) : job_task_num(0), next_task(0), busy_workers(0), job_generation(0),
+        stopping(false) {
+    if (thread_num == 0)
+        thread_num = thread::hardware_concurrency();
+
+    // The calling thread also runs tasks, so one less worker is needed
+    for (unsigned int i = 1; i < thread_num; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::workerLoop() {
+    unsigned long seen_generation = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(pool_mutex);
+            work_cv.wait(lock, [&]() { return stopping || job_generation != seen_generation; });
+            if (stopping)
+                return;
+            seen_generation = job_generation;
+        }
+
+        runTasks();
+
+        {
+            lock_guard<mutex> lock(pool_mutex);
+            busy_workers--;
+        }
+        done_cv.notify_all();
+    }
+}
+
+
+void ThreadPool::runTasks() {
+    unsigned int task_i = next_task.fetch_add(1);
+    while (task_i < job_task_num) {
+        job(task_i);
+        task_i = next_task.fetch_add(1);
+    }
+}
+
+
+void ThreadPool::parallelFor(unsigned int task_num, function<void(unsigned int)> task_f) {
+    // No need to wake up workers for a single task
+    if (workers.empty() || task_num <= 1) {
+        for (unsigned int task_i = 0; task_i < task_num; task_i++)
+            task_f(task_i);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        job = task_f;
+        job_task_num = task_num;
+        next_task = 0;
+        busy_workers = workers.size();
+        job_generation++;
+    }
+    work_cv.notify_all();
+
+    runTasks();
+
+    // Wait for the workers to finish their last tasks
+    unique_lock<mutex> lock(pool_mutex);
+    done_cv.wait(lock, [&]() { return busy_workers == 0; });
+    job = nullptr;
+}
+
+
+unsigned int ThreadPool::getThreadNum() { return workers.size() + 1; }
+
+
+void get_chunk_bounds(unsigned int item_num, unsigned int chunk_num, unsigned int chunk_i, unsigned int* begin,
+        unsigned int* end) {
+    *begin = (unsigned long) item_num * chunk_i / chunk_num;
+    *end = (unsigned long) item_num * (chunk_i + 1) / chunk_num;
+}
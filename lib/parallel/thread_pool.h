@@ -0,0 +1,57 @@
+#ifndef LIB_THREAD_POOL
+#define LIB_THREAD_POOL
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*
+ * Thread Pool
+ *
+ * Fixed number of worker threads, created once and reused by every parallel algorithm of the project
+ *
+ * Work is given as a number of independent tasks (usually chunks of an input vector), which the workers and the
+ * calling thread take in turns until all of them are done, so the caller is blocked until the whole job is finished
+ * A pool of one thread runs everything in the calling thread
+ *
+ * Jobs cannot be nested, a task must not call parallelFor on the same pool
+ */
+
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex pool_mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    // Current job, workers wake up when the generation changes
+    std::function<void(unsigned int)> job;
+    unsigned int job_task_num;
+    std::atomic<unsigned int> next_task;
+    unsigned int busy_workers;
+    unsigned long job_generation;
+    bool stopping;
+
+    void workerLoop();
+    void runTasks();
+
+public:
+    // Zero threads means one for each available core
+    ThreadPool(unsigned int thread_num);
+    ~ThreadPool();
+
+    // Call task_f(task_i) for every task_i in [0, task_num) and return when all calls have finished
+    void parallelFor(unsigned int task_num, std::function<void(unsigned int)> task_f);
+
+    unsigned int getThreadNum();
+};
+
+// Split [0, item_num) into chunk_num contiguous chunks and get the bounds of one of them
+void get_chunk_bounds(unsigned int item_num, unsigned int chunk_num, unsigned int chunk_i, unsigned int* begin,
+        unsigned int* end);
+
+#endif //LIB_THREAD_POOL
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <functional>
+#include <cstdint>
 
 #include "utils.hpp"
 
@@ -50,6 +52,17 @@ vector<int> get_num_hamming_dist_from(int num, int dist, int min_bit, int bits)
 }
 
 
+unsigned long derive_seed(unsigned long seed, unsigned long stream) {
+    // Mix the seed and the stream number (splitmix64), so that close seeds and streams give unrelated generators
+    uint64_t mixed = (uint64_t) seed + (stream + 1) * 0x9e3779b97f4a7c15ULL;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    mixed = mixed ^ (mixed >> 31);
+
+    return (unsigned long) mixed;
+}
+
+
 vector<string> file_to_args(string filename, char delimiter) {
     vector<string> args;
 
@@ -92,56 +105,78 @@ vector< vector<string> > file_to_str_vectors(string filename, char delimiter) {
 }
 
 
-vector< vector<string> > file_to_str_vectors(string filename, char delimiter, int* P) {
-    vector< vector<string> > vecs;
+std::unordered_map<string, float> file_to_lexicon(string filename, char delimiter) {
+    std::unordered_map<string, float> lexicon;
 
     ifstream input_file;
     input_file.open(filename);
     if ( !input_file.is_open() )
-        return vecs;
+        return lexicon;
 
     string line;
-
-    // Read P from input vector file
-    {
-        getline(input_file, line);
-        if (line[line.size()-1] == '\r')
-            line.erase(line.size() - 1);
-        vector<string> current_vector = split(line, delimiter);
-        if (current_vector.size() > 1)
-            *P = stoi(current_vector[1]);
-    }
-
-
     while (getline(input_file, line)) {
-        // Remove windows carriage return
-        if (line[line.size()-1] == '\r')
-            line.erase(line.size() - 1);
-
-        vector<string> current_vector = split(line, delimiter);
-        vecs.emplace_back(current_vector);
+        vector<string> current_word = split(line, delimiter);
+        float score = stof(current_word[1]);
+        lexicon.emplace(current_word[0], score);
     }
 
     input_file.close();
-    return vecs;
+    return lexicon;
 }
 
 
-std::unordered_map<string, float> file_to_lexicon(string filename, char delimiter) {
-    std::unordered_map<string, float> lexicon;
-
+int read_tweets(string filename, char delimiter, int* P, unordered_map<string, float>& lexicon,
+        vector< vector<string> >& query_crypto, function<void (Tweet&)> tweet_f, unsigned int chunk_size) {
     ifstream input_file;
-    input_file.open(filename);
+    input_file.open(filename, ios::binary);
     if ( !input_file.is_open() )
-        return lexicon;
+        return -1;
+
+    int tweet_num = 0;
+    bool first_line = true;
+    auto read_line = [&](string& line) {
+        // Remove windows carriage return
+        if (!line.empty() && line[line.size()-1] == '\r')
+            line.erase(line.size() - 1);
 
+        vector<string> words = split(line, delimiter);
+
+        // Read P from input tweet file
+        if (first_line) {
+            first_line = false;
+            if (words.size() > 1)
+                *P = stoi(words[1]);
+            return;
+        }
+
+        // Skip lines without a user and a tweet id
+        if (words.size() < 2)
+            return;
+
+        Tweet tweet(words, lexicon, query_crypto);
+        tweet_f(tweet);
+        tweet_num++;
+    };
+
+    // The part of the last line of a chunk that continues in the next one is kept in line
+    vector<char> chunk(chunk_size);
     string line;
-    while (getline(input_file, line)) {
-        vector<string> current_word = split(line, delimiter);
-        float score = stof(current_word[1]);
-        lexicon.emplace(current_word[0], score);
+    while (input_file.read(chunk.data(), chunk.size()) || input_file.gcount() > 0) {
+        unsigned int read_size = input_file.gcount();
+        unsigned int line_begin = 0;
+        for (unsigned int i = 0; i < read_size; i++) {
+            if (chunk[i] == '\n') {
+                line.append(chunk.data() + line_begin, i - line_begin);
+                read_line(line);
+                line.clear();
+                line_begin = i + 1;
+            }
+        }
+        line.append(chunk.data() + line_begin, read_size - line_begin);
     }
+    if (!line.empty())
+        read_line(line);
 
     input_file.close();
-    return lexicon;
+    return tweet_num;
 }
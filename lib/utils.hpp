@@ -29,6 +29,10 @@ std::vector<std::string> split(const std::string& s, char delimiter);
 // Bits is the number of bits the input number is made of (for the cases of the binary hash functions)
 std::vector<int> get_num_hamming_dist_from(int num, int dist, int min_bit, int bits);
 
+// Seed of an independent random stream, derived from a single seed and the number of the stream
+// Every randomized part of the program seeds its generator with its own stream, so one seed reproduces a whole run
+unsigned long derive_seed(unsigned long seed, unsigned long stream);
+
 // Split input string, with input delimiter and return a vector of the resulting strings converted
 // the numbers are passed to the input conversion_f lambda
 template <typename conv_type>
@@ -67,13 +71,22 @@ std::vector<std::string> file_to_args(std::string filename, char delimiter);
 
 // Return vector that contains vector of strings from input file
 std::vector< std::vector<std::string> > file_to_str_vectors(std::string filename, char delimiter);
-// If needed, also read P from input vector file
-std::vector< std::vector<std::string> > file_to_str_vectors(std::string filename, char delimiter, int* P);
 
 // Return an unordered map that is used to bind a word to a score
 // Used for tweet sentiment analysis
 std::unordered_map<std::string, float> file_to_lexicon(std::string filename, char delimiter);
 
+// Size of the chunks tweets are read in
+const unsigned int TWEET_CHUNK_SIZE = 1 << 20;
+
+// Read tweets from input file, one per line, and pass each one to tweet_f as soon as it is scored
+// The file is read in chunks of chunk_size bytes, so only the tweet being scored is kept in memory, P is read from the
+// first line
+// Returns the number of tweets read, or -1 if the file could not be opened
+int read_tweets(std::string filename, char delimiter, int* P, std::unordered_map<std::string, float>& lexicon,
+        std::vector< std::vector<std::string> >& query_crypto, std::function<void (Tweet&)> tweet_f,
+        unsigned int chunk_size = TWEET_CHUNK_SIZE);
+
 
 
 
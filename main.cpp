@@ -4,35 +4,61 @@
 #include <chrono>
 #include <random>
 #include <vector>
+#include <unordered_set>
 #include <utility>
+#include <algorithm>
 #include <cmath>
 
 #include "./lib/in_out/arg_parser.h"
 #include "./lib/in_out/vector_reader.hpp"
 #include "./lib/data_structures/cust_vector.hpp"
 #include "./lib/data_structures/cust_hashtable.hpp"
+#include "./lib/data_structures/kmeans_centers.hpp"
+#include "./lib/data_structures/kmeans_bounds.h"
 #include "./lib/data_structures/tweet.h"
+#include "./lib/data_structures/user_sentiments.h"
+#include "./lib/data_structures/candidate_set.h"
 #include "./lib/lsh_cube.hpp"
 #include "./lib/clustering_phases/initialization.hpp"
 #include "./lib/clustering_phases/assignment.hpp"
 #include "./lib/clustering_phases/update.hpp"
 #include "./lib/clustering_phases/silhouette.hpp"
 #include "./lib/crypto_rec.hpp"
+#include "./lib/batch_recommender.hpp"
+#include "./lib/parallel/thread_pool.h"
 
 using namespace std;
 
+// Random streams of the randomized parts of the program, each one seeded with derive_seed(seed, stream)
+enum RandomStream {
+    PROJ_2_INIT_STREAM, PROJ_2_UPDATE_STREAM, PROJ_2_SILHOUETTE_STREAM,
+    LSH_A_STREAM, LSH_A_VALIDATION_STREAM, LSH_B_STREAM, LSH_B_VALIDATION_STREAM,
+    CLUSTERING_A_INIT_STREAM, CLUSTERING_A_SILHOUETTE_STREAM,
+    CLUSTERING_B_INIT_STREAM, CLUSTERING_B_SILHOUETTE_STREAM
+};
+
 double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors, string metric_type, int k, int L,
-        int lsh_bucket_div, double euclidean_h_w, int P);
+        int lsh_bucket_div, double euclidean_h_w, int lsh_probes, int lsh_max_candidates, int P, unsigned long seed,
+        ThreadPool& pool);
 
-void get_recommendation_args(int argc, char* argv[], string* input_file, string* output_file, bool* validate);
+void get_recommendation_args(int argc, char* argv[], string* input_file, string* output_file, bool* validate,
+        bool* seed_given, unsigned long* seed);
 
 void get_config(string config_file, string* proj_2_input, char* proj_2_csv_delimiter, int* proj_2_cluster_num,
                 int* cluster_num, int* k, int* L, int* lsh_bucket_div, double* euclidean_h_w, char* csv_delimiter,
-                int* max_algo_iterations, double* min_dist_kmeans, string* lexicon_file, string* query_file);
+                int* max_algo_iterations, double* min_dist_kmeans, string* lexicon_file, string* query_file,
+                int* threads, string* assignment_algorithm, string* update_algorithm, int* mini_batch_size,
+                int* mini_batch_patience, string* silhouette_mode, int* silhouette_samples,
+                string* initialization_algorithm, int* init_rounds, double* init_oversampling, unsigned long* seed,
+                int* lsh_probes, int* lsh_max_candidates, string* kernel_isa);
 
 void print_recommendations(std::ostream& os, string user_id, vector<int> recom_crypto_indexes,
         vector< vector<string> > query_crypto, int name_index);
 
+void report_silhouette(string clustering_name, vector< CustVector<double> >& input_vectors,
+        vector<CustVector<double> *>& centroids, string metric_type, string silhouette_mode, int silhouette_samples,
+        unsigned long seed, ThreadPool& pool);
+
 int main(int argc, char* argv[]) {
 
     /*
@@ -43,8 +69,11 @@ int main(int argc, char* argv[]) {
     // Get program options from arguments
     string input_file, config_file, output_file;
     bool validate = false;
+    // A seed given as an argument overrides the one of the configuration file
+    bool arg_seed_given = false;
+    unsigned long arg_seed = 0;
 
-    get_recommendation_args(argc, argv, &input_file, &output_file, &validate);
+    get_recommendation_args(argc, argv, &input_file, &output_file, &validate, &arg_seed_given, &arg_seed);
     config_file = "./cluster.conf";
 
     // Get all necessary program options from configuration file, even configurations for assignment 2 clustering
@@ -57,13 +86,44 @@ int main(int argc, char* argv[]) {
     int L = 5;
     int lsh_bucket_div = 4;
     double euclidean_h_w = 0.01;
+    int lsh_probes = 1;
+    int lsh_max_candidates = 0;
     int max_algo_iterations = 30;
     double min_dist_kmeans = 0.05;
     char csv_delimiter = ' ';
     string lexicon_file, query_file;
+    int threads = 1;
+    string assignment_algorithm = "lloyds";
+    string update_algorithm = "k_means";
+    int mini_batch_size = 1000;
+    int mini_batch_patience = 10;
+    string silhouette_mode = "none";
+    int silhouette_samples = 1000;
+    string initialization_algorithm = "k_means_pp";
+    int init_rounds = 5;
+    double init_oversampling = 2;
+    // Without a seed option, every run is different
+    unsigned long seed = chrono::system_clock::now().time_since_epoch().count();
+    // Best instruction set of this CPU unless forced
+    string kernel_isa = "auto";
 
     get_config(config_file, &proj_2_input, &proj_2_csv_delimiter, &proj_2_cluster_num, &cluster_num, &k, &L,
-            &lsh_bucket_div, &euclidean_h_w, &csv_delimiter, &max_algo_iterations, &min_dist_kmeans, &lexicon_file, &query_file);
+            &lsh_bucket_div, &euclidean_h_w, &csv_delimiter, &max_algo_iterations, &min_dist_kmeans, &lexicon_file, &query_file,
+            &threads, &assignment_algorithm, &update_algorithm, &mini_batch_size, &mini_batch_patience,
+            &silhouette_mode, &silhouette_samples, &initialization_algorithm, &init_rounds, &init_oversampling, &seed,
+            &lsh_probes, &lsh_max_candidates, &kernel_isa);
+    if (arg_seed_given)
+        seed = arg_seed;
+    cout << "Random seed: " << seed << endl;
+
+    // The kernels of each instruction set sum in a different order, so only runs with the same one give the exact
+    // same results for the same seed
+    if (kernel_isa != "auto" && !set_kernel_isa(kernel_isa))
+        cerr << "Unsupported kernel instruction set " << kernel_isa << ", using " << get_kernel_isa() << endl;
+    cout << "Kernel instruction set: " << get_kernel_isa() << endl;
+
+    // Worker threads, created once and shared by all parallel algorithms
+    ThreadPool pool(threads);
 
 
     /*
@@ -93,21 +153,32 @@ int main(int argc, char* argv[]) {
     // Fast and accurate clustering
     {
         string metric_type = "cosine";
-        vector<CustVector<double> *> centroids = k_means_pp(input_vectors_of_2, proj_2_cluster_num, metric_type);
-        int clustering_iterations = 0;
-        bool continue_clustering = true;
-        while (continue_clustering == true && clustering_iterations < max_algo_iterations) {
-            lloyds_assignment(input_vectors_of_2, centroids, metric_type);
-            continue_clustering = k_means(input_vectors_of_2, centroids, metric_type, min_dist_kmeans);
-            clustering_iterations++;
+        vector<CustVector<double> *> initial_centroids;
+        if (initialization_algorithm == "k_means_parallel")
+            initial_centroids = k_means_parallel(input_vectors_of_2, proj_2_cluster_num, metric_type, init_rounds,
+                    init_oversampling * proj_2_cluster_num, derive_seed(seed, PROJ_2_INIT_STREAM), pool);
+        else
+            initial_centroids = k_means_pp(input_vectors_of_2, proj_2_cluster_num, metric_type,
+                    derive_seed(seed, PROJ_2_INIT_STREAM));
+        KMeansCenters<double> centers(initial_centroids, min(LLOYDS_CHUNK_NUM, (unsigned int) input_vectors_of_2.size()));
+        if (update_algorithm == "mini_batch") {
+            // As many batches as would take max_algo_iterations passes over the input
+            int max_batches = max_algo_iterations * max(1, (int) input_vectors_of_2.size() / mini_batch_size);
+            mini_batch_k_means(input_vectors_of_2, centers, metric_type, mini_batch_size, max_batches,
+                    mini_batch_patience, min_dist_kmeans, derive_seed(seed, PROJ_2_UPDATE_STREAM), pool);
         }
+        else {
+            int clustering_iterations = 0;
+            bool continue_clustering = true;
+            while (continue_clustering == true && clustering_iterations < max_algo_iterations) {
+                continue_clustering = lloyds_k_means(input_vectors_of_2, centers, metric_type, min_dist_kmeans, pool);
+                clustering_iterations++;
+            }
+        }
+        vector<CustVector<double> *>& centroids = centers.getCenters();
 
-        //clusters_of_2 = separate_clusters_from_input(input_vectors_of_2, centroids.size());
-        //std::vector<double> sill = silhouette_cluster(clusters_of_2, centroids, metric_type);
-
-        // If k-means is used then delete centers
-        for (int i = 0; i < centroids.size(); i++)
-            delete centroids[i];
+        report_silhouette("Proj 2 clustering", input_vectors_of_2, centroids, metric_type, silhouette_mode,
+                silhouette_samples, derive_seed(seed, PROJ_2_SILHOUETTE_STREAM), pool);
     }
 
 
@@ -118,23 +189,42 @@ int main(int argc, char* argv[]) {
 
 
     int P = 1;
-    vector< vector<string> > input_tweets = file_to_str_vectors(input_file, csv_delimiter, &P);
     vector< vector<string> > query_crypto = file_to_str_vectors(query_file, csv_delimiter);
     unordered_map<string, float> lexicon = file_to_lexicon(lexicon_file, csv_delimiter);
 
-
-
-    // Create tweet unordered map
-    unordered_map<string, Tweet> tweets;
-    for (auto& tweet_words : input_tweets) {
-        Tweet tweetWStats(tweet_words, lexicon, query_crypto);
-        tweets.emplace(tweetWStats.getId(), tweetWStats);
+    // Clusters of the assignment 2 vectors of each tweet, every cluster is a fake user
+    unordered_map< string, vector<int> > tweet_clusters;
+    for (auto& vec : input_vectors_of_2)
+        tweet_clusters[vec.getId()].emplace_back(vec.getCluster());
+
+    UserSentiments user_sentiments(query_crypto.size());
+    UserSentiments cluster_sentiments(query_crypto.size());
+    for (int cluster_i = 0; cluster_i < proj_2_cluster_num; cluster_i++)
+        cluster_sentiments.addUser(to_string(cluster_i));
+
+    // Stream the tweets, adding the sentiment of each one to its user and to the clusters of its vectors
+    // Only the first tweet with each id counts, repeated ids are skipped
+    unordered_set<string> tweet_ids;
+    int tweet_num = read_tweets(input_file, csv_delimiter, &P, lexicon, query_crypto, [&](Tweet& tweet) {
+        if (!tweet_ids.insert(tweet.getId()).second)
+            return;
+
+        user_sentiments.addTweet(user_sentiments.addUser(tweet.getUserId()), tweet);
+
+        auto clusters = tweet_clusters.find(tweet.getId());
+        if (clusters != tweet_clusters.end()) {
+            for (int cluster_i : clusters->second)
+                cluster_sentiments.addTweet(cluster_i, tweet);
+        }
+    });
+    if (tweet_num < 0) {
+        std::cerr << "Error opening file " + input_file << std::endl;
+        return -1;
     }
 
-    // Convert tweets to user vectors, also filter useless users and give the unknown rating the value of the vector's mean
-    vector< CustVector<double> > user_vectors = tweets_to_user_vectors<double>(tweets, query_crypto.size());
-    vector< CustVector<double> > fake_user_vectors = clusters_to_user_vectors(tweets, input_vectors_of_2,
-            query_crypto.size(), proj_2_cluster_num);
+    // Convert sentiments to user vectors, also filter useless users and give the unknown rating the value of the vector's mean
+    vector< CustVector<double> > user_vectors = sentiments_to_user_vectors<double>(user_sentiments);
+    vector< CustVector<double> > fake_user_vectors = sentiments_to_user_vectors<double>(cluster_sentiments);
 
     //input_vectors_of_2.resize(0);
     ofstream outFile(output_file);
@@ -153,32 +243,52 @@ int main(int argc, char* argv[]) {
 
         // Create LSH hashtables for LSH recommendation
         vector<CustHashtable<double>*> lsh_hashtables = create_LSH_hashtables<double>(user_vectors, metric_type, k, L,
-                lsh_bucket_div, euclidean_h_w);
-
-        // For each user, calculate actual recommendations
-        for (auto &user : user_vectors) {
-            std::vector< CustVector<double>* > neighbors = get_LSH_filtered_combined_buckets(lsh_hashtables, &user);
-            if (!neighbors.empty()) {
-                vector<double> similarities1 = get_P_closest(neighbors, user, P);
-
-                // Get top 5 recommendations
-                // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
-                // mean value. So during this proccess the mean of the vector is subtracted from each rating
-                vector<int> recom_crypto_indexes1 = get_top_N_recom(neighbors, user, 5, similarities1);
-                print_recommendations(outFile, user.getId(), recom_crypto_indexes1, query_crypto, 4);
+                lsh_bucket_div, euclidean_h_w, derive_seed(seed, LSH_A_STREAM), pool);
+
+        // Group the users by their candidates, then calculate the recommendations of every group at once
+        // Groups are scored and cleared in batches, so that the candidates they hold stay bounded
+        // The candidate set and buffers are reused by every query
+        CandidateSet candidates(user_vectors.size(), lsh_max_candidates);
+        ProbeBuffer<double> probes;
+        std::vector< CustVector<double>* > neighbors;
+        BatchRecommender<double> recommender(user_vectors.size());
+        vector< vector<int> > recommendations;
+        int batch_begin = 0;
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
+            get_LSH_filtered_combined_buckets(lsh_hashtables, &user_vectors[user_i], lsh_probes, candidates, probes, neighbors);
+            if (!neighbors.empty())
+                recommender.addUser(user_i, neighbors);
+
+            if (recommender.getCandidateNumber() < RECOMMENDATION_BATCH_CANDIDATES && user_i + 1 < user_vectors.size())
+                continue;
+
+            // Get top 5 recommendations
+            // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
+            // mean value. So during this proccess the mean of the vector is subtracted from each rating
+            recommender.recommend(user_vectors, P, 5, &recommendations, pool);
+            for (int batch_i = batch_begin; batch_i <= user_i; batch_i++) {
+                if (recommender.hasCandidates(batch_i))
+                    print_recommendations(outFile, user_vectors[batch_i].getId(), recommendations[batch_i], query_crypto, 4);
             }
+            recommender.clear();
+            batch_begin = user_i + 1;
         }
 
         chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
         outFile << "Execution Time: " << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << endl;
 
+        if (lsh_max_candidates > 0)
+            cout << "Cosine LSH A candidate cap reached in " << candidates.getCappedNumber() << " of "
+                 << candidates.getQueryNumber() << " queries" << endl;
+
         for (int i = 0; i < lsh_hashtables.size(); i++)
             delete lsh_hashtables[i];
 
 
         // 10-fold cross-validation
         if (validate) {
-            double validation = lsh_rec_10_fold_validation_A(user_vectors, metric_type, k, L, lsh_bucket_div, euclidean_h_w, P);
+            double validation = lsh_rec_10_fold_validation_A(user_vectors, metric_type, k, L, lsh_bucket_div, euclidean_h_w, lsh_probes,
+                    lsh_max_candidates, P, derive_seed(seed, LSH_A_VALIDATION_STREAM), pool);
             cout << " aa" << validation << endl;
         }
 
@@ -199,32 +309,52 @@ int main(int argc, char* argv[]) {
 
         // Create LSH hashtables for LSH recommendation
         vector<CustHashtable<double>*> lsh_hashtables = create_LSH_hashtables<double>(fake_user_vectors, metric_type, k, L,
-                lsh_bucket_div, euclidean_h_w);
-
-        // For each user, calculate actual recommendations
-        for (auto &user : user_vectors) {
-            std::vector< CustVector<double>* > neighbors = get_LSH_filtered_combined_buckets(lsh_hashtables, &user);
-            if (!neighbors.empty()) {
-                vector<double> similarities = get_P_closest(neighbors, user, P);
-
-                // Get top 2 recommendations
-                // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
-                // mean value. So during this proccess the mean of the vector is subtracted from each rating
-                vector<int> recom_crypto_indexes = get_top_N_recom(neighbors, user, 2, similarities);
-                print_recommendations(outFile, user.getId(), recom_crypto_indexes, query_crypto, 4);
+                lsh_bucket_div, euclidean_h_w, derive_seed(seed, LSH_B_STREAM), pool);
+
+        // Group the users by their candidates, then calculate the recommendations of every group at once
+        // Groups are scored and cleared in batches, so that the candidates they hold stay bounded
+        // The candidate set and buffers are reused by every query
+        CandidateSet candidates(fake_user_vectors.size(), lsh_max_candidates);
+        ProbeBuffer<double> probes;
+        std::vector< CustVector<double>* > neighbors;
+        BatchRecommender<double> recommender(user_vectors.size());
+        vector< vector<int> > recommendations;
+        int batch_begin = 0;
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
+            get_LSH_filtered_combined_buckets(lsh_hashtables, &user_vectors[user_i], lsh_probes, candidates, probes, neighbors);
+            if (!neighbors.empty())
+                recommender.addUser(user_i, neighbors);
+
+            if (recommender.getCandidateNumber() < RECOMMENDATION_BATCH_CANDIDATES && user_i + 1 < user_vectors.size())
+                continue;
+
+            // Get top 2 recommendations
+            // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
+            // mean value. So during this proccess the mean of the vector is subtracted from each rating
+            recommender.recommend(user_vectors, P, 2, &recommendations, pool);
+            for (int batch_i = batch_begin; batch_i <= user_i; batch_i++) {
+                if (recommender.hasCandidates(batch_i))
+                    print_recommendations(outFile, user_vectors[batch_i].getId(), recommendations[batch_i], query_crypto, 4);
             }
+            recommender.clear();
+            batch_begin = user_i + 1;
         }
 
         chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
         outFile << "Execution Time: " << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << endl;
 
+        if (lsh_max_candidates > 0)
+            cout << "Cosine LSH B candidate cap reached in " << candidates.getCappedNumber() << " of "
+                 << candidates.getQueryNumber() << " queries" << endl;
+
         for (int i = 0; i < lsh_hashtables.size(); i++)
             delete lsh_hashtables[i];
 
 
         // 10-fold cross-validation
         //if (validate) {
-        //    lsh_rec_10_fold_validation_B(user_vectors, fake_user_vectors, metric_type, k, L, lsh_bucket_div, euclidean_h_w, P);
+        //    lsh_rec_10_fold_validation_B(user_vectors, fake_user_vectors, metric_type, k, L, lsh_bucket_div, euclidean_h_w,
+        //            lsh_probes, lsh_max_candidates, P, derive_seed(seed, LSH_B_VALIDATION_STREAM), pool);
         //}
 
     }
@@ -243,37 +373,50 @@ int main(int argc, char* argv[]) {
         chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
 
         // Begin clustering
-        vector<CustVector<double> *> centroids = rand_selection(user_vectors, cluster_num);
-        //vector<CustVector<double> *> centroids = k_means_pp(user_vectors, cluster_num, metric_type);
+        vector<CustVector<double> *> initial_centroids = rand_selection(user_vectors, cluster_num,
+                derive_seed(seed, CLUSTERING_A_INIT_STREAM));
+        //vector<CustVector<double> *> centroids = k_means_pp(user_vectors, cluster_num, metric_type, seed);
+        KMeansCenters<double> centers(initial_centroids, min(LLOYDS_CHUNK_NUM, (unsigned int) user_vectors.size()));
+        KMeansBounds bounds(user_vectors.size(), centers.getClusterNumber(), centers.getChunkNumber());
         int clustering_iterations = 0;
         bool continue_clustering = true;
         while (continue_clustering == true && clustering_iterations < max_algo_iterations) {
-            lloyds_assignment(user_vectors, centroids, metric_type);
-            continue_clustering = k_means(user_vectors, centroids, metric_type, min_dist_kmeans);
+            if (assignment_algorithm == "hamerly")
+                continue_clustering = hamerly_k_means(user_vectors, centers, bounds, min_dist_kmeans, pool);
+            else
+                continue_clustering = lloyds_k_means(user_vectors, centers, metric_type, min_dist_kmeans, pool);
             clustering_iterations++;
         }
+        if (bounds.getPrunedNumber() > 0)
+            cout << "Hamerly assignment skipped " << bounds.getPrunedNumber() << " of "
+                 << bounds.getPrunedNumber() + bounds.getComputedNumber() << " distance calculations" << endl;
+        vector<CustVector<double> *>& centroids = centers.getCenters();
         std::vector< std::vector<CustVector<double>*> > clusters = separate_clusters_from_input(user_vectors,
                 centroids.size());
-        //std::vector<double> sill = silhouette_cluster(user_vectors, centroids, metric_type);
-
-        // Begin calculating optimal recommendations
-        for (auto &user : user_vectors) {
-            std::vector< CustVector<double>* > neighbors = clusters[user.getCluster()];
-            if (!neighbors.empty()) {
-                // Get top 5 recommendations
-                // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
-                // mean value. So during this proccess the mean of the vector is subtracted from each rating
-                vector<int> recom_crypto_indexes = get_top_N_recom(neighbors, user, 5);
-                print_recommendations(outFile, user.getId(), recom_crypto_indexes, query_crypto, 4);
-            }
+        report_silhouette("Clustering Recommendation A", user_vectors, centroids, metric_type, silhouette_mode,
+                silhouette_samples, derive_seed(seed, CLUSTERING_A_SILHOUETTE_STREAM), pool);
+
+        // Begin calculating optimal recommendations, the neighbors of each user are all the users of its cluster
+        BatchRecommender<double> recommender(user_vectors.size());
+        for (auto& cluster : clusters)
+            recommender.addGroup(cluster);
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
+            if (!clusters[user_vectors[user_i].getCluster()].empty())
+                recommender.addUserToGroup(user_i, user_vectors[user_i].getCluster());
+        }
+
+        // Get top 5 recommendations
+        // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
+        // mean value. So during this proccess the mean of the vector is subtracted from each rating
+        vector< vector<int> > recommendations;
+        recommender.recommend(user_vectors, 0, 5, &recommendations, pool);
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
+            if (recommender.hasCandidates(user_i))
+                print_recommendations(outFile, user_vectors[user_i].getId(), recommendations[user_i], query_crypto, 4);
         }
 
-        //std::vector<double> sill = silhouette_cluster(clusters, centroids, metric_type);
         chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
         outFile << "Execution Time: " << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << endl;
-        // If k-means is used then delete centers
-        for (int i = 0; i < centroids.size(); i++)
-            delete centroids[i];
 
 
         // 10-fold cross-validation
@@ -337,22 +480,41 @@ int main(int argc, char* argv[]) {
         chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
 
         // Begin clustering
-        vector<CustVector<double> *> centroids = k_means_pp(fake_user_vectors, cluster_num, metric_type);
+        vector<CustVector<double> *> initial_centroids;
+        if (initialization_algorithm == "k_means_parallel")
+            initial_centroids = k_means_parallel(fake_user_vectors, cluster_num, metric_type, init_rounds,
+                    init_oversampling * cluster_num, derive_seed(seed, CLUSTERING_B_INIT_STREAM), pool);
+        else
+            initial_centroids = k_means_pp(fake_user_vectors, cluster_num, metric_type,
+                    derive_seed(seed, CLUSTERING_B_INIT_STREAM));
+        KMeansCenters<double> centers(initial_centroids, min(LLOYDS_CHUNK_NUM, (unsigned int) fake_user_vectors.size()));
+        KMeansBounds bounds(fake_user_vectors.size(), centers.getClusterNumber(), centers.getChunkNumber());
         int clustering_iterations = 0;
         bool continue_clustering = true;
         while (continue_clustering == true && clustering_iterations < max_algo_iterations) {
-            lloyds_assignment(fake_user_vectors, centroids, metric_type);
-            continue_clustering = k_means(fake_user_vectors, centroids, metric_type, min_dist_kmeans);
+            if (assignment_algorithm == "hamerly")
+                continue_clustering = hamerly_k_means(fake_user_vectors, centers, bounds, min_dist_kmeans, pool);
+            else
+                continue_clustering = lloyds_k_means(fake_user_vectors, centers, metric_type, min_dist_kmeans, pool);
             clustering_iterations++;
         }
+        if (bounds.getPrunedNumber() > 0)
+            cout << "Hamerly assignment skipped " << bounds.getPrunedNumber() << " of "
+                 << bounds.getPrunedNumber() + bounds.getComputedNumber() << " distance calculations" << endl;
+        vector<CustVector<double> *>& centroids = centers.getCenters();
         std::vector< std::vector<CustVector<double>*> > clusters = separate_clusters_from_input(fake_user_vectors,
                 centroids.size());
-        //std::vector<double> sill = silhouette_cluster(fake_user_vectors, centroids, metric_type);
-
-        // Begin calculating optimal recommendations
-        for (auto &user : user_vectors) {
+        report_silhouette("Clustering Recommendation B", fake_user_vectors, centroids, metric_type, silhouette_mode,
+                silhouette_samples, derive_seed(seed, CLUSTERING_B_SILHOUETTE_STREAM), pool);
+
+        // Begin calculating optimal recommendations, the neighbors of each user are all the users of its cluster
+        BatchRecommender<double> recommender(user_vectors.size());
+        for (auto& cluster : clusters)
+            recommender.addGroup(cluster);
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
             // Find out in what cluster the current user belongs to
             // Assign it to the cluster whose centroid is the closest
+            CustVector<double>& user = user_vectors[user_i];
             double min_dist = user.euclideanDistance(centroids[0]);
             int min_dist_i = 0;
             for (int centroid_i = 1; centroid_i < centroids.size(); centroid_i++) {
@@ -362,22 +524,22 @@ int main(int argc, char* argv[]) {
                     min_dist_i = centroid_i;
                 }
             }
-            std::vector< CustVector<double>* > neighbors = clusters[min_dist_i];
-            if (!neighbors.empty()) {
-                // Get top 2 recommendations
-                // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
-                // mean value. So during this proccess the mean of the vector is subtracted from each rating
-                vector<int> recom_crypto_indexes = get_top_N_recom(neighbors, user, 2);
-                print_recommendations(outFile, user.getId(), recom_crypto_indexes, query_crypto, 4);
-            }
+            if (!clusters[min_dist_i].empty())
+                recommender.addUserToGroup(user_i, min_dist_i);
+        }
+
+        // Get top 2 recommendations
+        // Note that the user vectors have not been normalized yet, only the unknown cryptocurrency values have the
+        // mean value. So during this proccess the mean of the vector is subtracted from each rating
+        vector< vector<int> > recommendations;
+        recommender.recommend(user_vectors, 0, 2, &recommendations, pool);
+        for (int user_i = 0; user_i < user_vectors.size(); user_i++) {
+            if (recommender.hasCandidates(user_i))
+                print_recommendations(outFile, user_vectors[user_i].getId(), recommendations[user_i], query_crypto, 4);
         }
 
-        //std::vector<double> sill = silhouette_cluster(clusters, centroids, metric_type);
         chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
         outFile << "Execution Time: " << chrono::duration_cast<chrono::milliseconds>(t2 - t1).count() << endl;
-        // If k-means is used then delete centers
-        for (int i = 0; i < centroids.size(); i++)
-            delete centroids[i];
     }
 
 
@@ -391,9 +553,13 @@ int main(int argc, char* argv[]) {
 
 
 double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors, string metric_type, int k, int L,
-        int lsh_bucket_div, double euclidean_h_w, int P) {
+        int lsh_bucket_div, double euclidean_h_w, int lsh_probes, int lsh_max_candidates, int P, unsigned long seed,
+        ThreadPool& pool) {
 
-    std::vector< std::vector< CustVector<double> > > separate_vectors = split_to_10<double>(user_vectors);
+    // The split, the hidden scores and the hashtables of each fold have their own random streams
+    std::vector< std::vector< CustVector<double> > > separate_vectors = split_to_10<double>(user_vectors,
+            derive_seed(seed, 0));
+    std::default_random_engine hide_generator(derive_seed(seed, 1));
 
     double all_sum = 0;
     for (int i = 0; i < 10; i++) {
@@ -401,16 +567,19 @@ double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors,
         // Each time query different vector group
         std::vector< CustVector<double> > curr_known = merge_except_for<double>(separate_vectors, i);
         vector<CustHashtable<double>*> temp_lsh_hashtables = create_LSH_hashtables<double>(curr_known,
-                metric_type, k, L, lsh_bucket_div, euclidean_h_w);
+                metric_type, k, L, lsh_bucket_div, euclidean_h_w, derive_seed(seed, 2 + i), pool);
 
         int calc_user_num = 0;
+        CandidateSet candidates(curr_known.size(), lsh_max_candidates);
+        ProbeBuffer<double> probes;
+        std::vector<CustVector<double>*> neighbors;
         for (auto& user : separate_vectors[i]) {
             // Hide a known value from user
             double old_score = 0;
-            bool calculate = hide_one_score(user, &old_score);
+            bool calculate = hide_one_score(user, &old_score, hide_generator);
 
             if (calculate) {
-                std::vector<CustVector<double>*> neighbors = get_LSH_filtered_combined_buckets(temp_lsh_hashtables, &user);
+                get_LSH_filtered_combined_buckets(temp_lsh_hashtables, &user, lsh_probes, candidates, probes, neighbors);
                 if (!neighbors.empty()) {
 
                     vector<double> similarities = get_P_closest(neighbors, user, P);
@@ -419,8 +588,8 @@ double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors,
                     int new_index = user.getUnknownIndexes().at(0);
                     k_sum = k_sum + fabs(old_score - pred[new_index]);
                     cout << k_sum << " ksum score " << endl;
-                    if (isnan(k_sum))
-                        int aaaa=0;
+                    //if (isnan(k_sum))
+                    //    int aaaa=0;
                     calc_user_num++;
                 }
             }
@@ -438,9 +607,12 @@ double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors,
 
 
 /*double lsh_rec_10_fold_validation_B(vector< CustVector<double> >& user_vectors, vector< CustVector<double> >& fake_user_vectors,
-        string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w, int P) {
+        string metric_type, int k, int L, int lsh_bucket_div, double euclidean_h_w, int lsh_probes, int lsh_max_candidates,
+        int P, unsigned long seed, ThreadPool& pool) {
 
-    std::vector< std::vector< CustVector<double> > > separate_vectors = split_to_10<double>(user_vectors);
+    std::vector< std::vector< CustVector<double> > > separate_vectors = split_to_10<double>(user_vectors,
+            derive_seed(seed, 0));
+    std::default_random_engine hide_generator(derive_seed(seed, 1));
 
     double all_sum = 0;
     for (int i = 0; i < 10; i++) {
@@ -448,16 +620,19 @@ double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors,
         // Each time query different vector group
         std::vector< CustVector<double> > curr_known = merge_except_for<double>(separate_vectors, i);
         vector<CustHashtable<double>*> temp_lsh_hashtables = create_LSH_hashtables<double>(curr_known,
-                metric_type, k, L, lsh_bucket_div, euclidean_h_w);
+                metric_type, k, L, lsh_bucket_div, euclidean_h_w, derive_seed(seed, 2 + i), pool);
 
         int calc_user_num = 0;
+        CandidateSet candidates(curr_known.size(), lsh_max_candidates);
+        ProbeBuffer<double> probes;
+        std::vector<CustVector<double>*> neighbors;
         for (auto& user : separate_vectors[i]) {
             // Hide a known value from user
             double old_score = 0;
-            bool calculate = hide_one_score(user, &old_score);
+            bool calculate = hide_one_score(user, &old_score, hide_generator);
 
             if (calculate) {
-                std::vector<CustVector<double>*> neighbors = get_LSH_filtered_combined_buckets(temp_lsh_hashtables, &user);
+                get_LSH_filtered_combined_buckets(temp_lsh_hashtables, &user, lsh_probes, candidates, probes, neighbors);
                 if (!neighbors.empty()) {
 
                     vector<double> similarities = get_P_closest(neighbors, user, P);
@@ -486,7 +661,8 @@ double lsh_rec_10_fold_validation_A(vector< CustVector<double> >& user_vectors,
 double clustering_rec_10_fold_validation();
 
 
-void get_recommendation_args(int argc, char* argv[], string* input_file, string* output_file, bool* validate) {
+void get_recommendation_args(int argc, char* argv[], string* input_file, string* output_file, bool* validate,
+        bool* seed_given, unsigned long* seed) {
     ArgParser* progArgs = new ArgParser(argc, argv);
 
     // For file paths, if no argument is given, request it from the user
@@ -504,6 +680,10 @@ void get_recommendation_args(int argc, char* argv[], string* input_file, string*
     }
     if (progArgs->flagExists("-validate"))
         *validate = true;
+    if (progArgs->flagExists("-seed")) {
+        *seed = stoul( progArgs->getFlagValue("-seed") );
+        *seed_given = true;
+    }
 
     delete progArgs;
 }
@@ -511,7 +691,10 @@ void get_recommendation_args(int argc, char* argv[], string* input_file, string*
 
 void get_config(string config_file, string* proj_2_input, char* proj_2_csv_delimiter, int* proj_2_cluster_num,
         int* cluster_num, int* k, int* L, int* lsh_bucket_div, double* euclidean_h_w, char* csv_delimiter,
-        int* max_algo_iterations, double* min_dist_kmeans, string* lexicon_file, string* query_file) {
+        int* max_algo_iterations, double* min_dist_kmeans, string* lexicon_file, string* query_file, int* threads,
+        string* assignment_algorithm, string* update_algorithm, int* mini_batch_size, int* mini_batch_patience,
+        string* silhouette_mode, int* silhouette_samples, string* initialization_algorithm, int* init_rounds,
+        double* init_oversampling, unsigned long* seed, int* lsh_probes, int* lsh_max_candidates, string* kernel_isa) {
 
     ArgParser* configArgs = new ArgParser( file_to_args(config_file, ' ') );
 
@@ -537,6 +720,10 @@ void get_config(string config_file, string* proj_2_input, char* proj_2_csv_delim
         *lsh_bucket_div = stoi( configArgs->getFlagValue("lsh_bucket_div") );
     if (configArgs->flagExists("euclidean_h_w"))
         *euclidean_h_w = stod( configArgs->getFlagValue("euclidean_h_w") );
+    if (configArgs->flagExists("lsh_probes"))
+        *lsh_probes = max(1, stoi( configArgs->getFlagValue("lsh_probes") ));
+    if (configArgs->flagExists("lsh_max_candidates"))
+        *lsh_max_candidates = max(0, stoi( configArgs->getFlagValue("lsh_max_candidates") ));
     if (configArgs->flagExists("max_algo_iterations"))
         *max_algo_iterations = stoi( configArgs->getFlagValue("max_algo_iterations") );
     if (configArgs->flagExists("min_dist_kmeans"))
@@ -549,6 +736,50 @@ void get_config(string config_file, string* proj_2_input, char* proj_2_csv_delim
         *lexicon_file = configArgs->getFlagValue("lexicon_file");
     if (configArgs->flagExists("query_file"))
         *query_file = configArgs->getFlagValue("query_file");
+    if (configArgs->flagExists("threads"))
+        *threads = stoi( configArgs->getFlagValue("threads") );
+    if (configArgs->flagExists("assignment_algorithm")) {
+        string algorithm = configArgs->getFlagValue("assignment_algorithm");
+        if (algorithm == "lloyds" || algorithm == "hamerly")
+            *assignment_algorithm = algorithm;
+        else
+            cerr << "Unknown assignment algorithm " << algorithm << ", using lloyds" << endl;
+    }
+    if (configArgs->flagExists("update_algorithm")) {
+        string algorithm = configArgs->getFlagValue("update_algorithm");
+        if (algorithm == "k_means" || algorithm == "mini_batch")
+            *update_algorithm = algorithm;
+        else
+            cerr << "Unknown update algorithm " << algorithm << ", using k_means" << endl;
+    }
+    if (configArgs->flagExists("mini_batch_size"))
+        *mini_batch_size = max(1, stoi( configArgs->getFlagValue("mini_batch_size") ));
+    if (configArgs->flagExists("mini_batch_patience"))
+        *mini_batch_patience = stoi( configArgs->getFlagValue("mini_batch_patience") );
+    if (configArgs->flagExists("silhouette")) {
+        string mode = configArgs->getFlagValue("silhouette");
+        if (mode == "none" || mode == "full" || mode == "sampled")
+            *silhouette_mode = mode;
+        else
+            cerr << "Unknown silhouette mode " << mode << ", using none" << endl;
+    }
+    if (configArgs->flagExists("silhouette_samples"))
+        *silhouette_samples = max(1, stoi( configArgs->getFlagValue("silhouette_samples") ));
+    if (configArgs->flagExists("initialization_algorithm")) {
+        string algorithm = configArgs->getFlagValue("initialization_algorithm");
+        if (algorithm == "k_means_pp" || algorithm == "k_means_parallel")
+            *initialization_algorithm = algorithm;
+        else
+            cerr << "Unknown initialization algorithm " << algorithm << ", using k_means_pp" << endl;
+    }
+    if (configArgs->flagExists("k_means_parallel_rounds"))
+        *init_rounds = max(1, stoi( configArgs->getFlagValue("k_means_parallel_rounds") ));
+    if (configArgs->flagExists("k_means_parallel_oversampling"))
+        *init_oversampling = stod( configArgs->getFlagValue("k_means_parallel_oversampling") );
+    if (configArgs->flagExists("seed"))
+        *seed = stoul( configArgs->getFlagValue("seed") );
+    if (configArgs->flagExists("kernel_isa"))
+        *kernel_isa = configArgs->getFlagValue("kernel_isa");
 
     delete configArgs;
 }
@@ -567,3 +798,20 @@ void print_recommendations(std::ostream& os, string user_id, vector<int> recom_c
     }
     os << "\n";
 }
+
+
+void report_silhouette(string clustering_name, vector< CustVector<double> >& input_vectors,
+        vector<CustVector<double> *>& centroids, string metric_type, string silhouette_mode, int silhouette_samples,
+        unsigned long seed, ThreadPool& pool) {
+    if (silhouette_mode == "full") {
+        vector<double> sils = parallel_silhouette(input_vectors, centroids, metric_type, pool);
+        cout << clustering_name << " silhouette: " << sils[sils.size()-1] << endl;
+    }
+    else if (silhouette_mode == "sampled") {
+        double confidence_interval = 0;
+        double sil = sampled_silhouette(input_vectors, centroids, metric_type, silhouette_samples, seed, pool,
+                &confidence_interval);
+        cout << clustering_name << " silhouette: " << sil << " +- " << confidence_interval << " (95% confidence, "
+             << silhouette_samples << " samples)" << endl;
+    }
+}
@@ -1,11 +1,47 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include "catch.hpp"
 #include <vector>
+#include <set>
+#include <fstream>
+#include <cstdio>
 
 #include "./lib/utils.hpp"
+#include "./lib/kernels/distance_kernels.hpp"
+#include "./lib/parallel/thread_pool.h"
+#include "./lib/data_structures/distance_cache.h"
+#include "./lib/data_structures/candidate_set.h"
+#include "./lib/data_structures/cust_hashtable.hpp"
+#include "./lib/generators/cosine_g_gen.hpp"
+#include "./lib/generators/euclidean_phi_gen.hpp"
+#include "./lib/generators/euclidean_f_gen.hpp"
+#include "./lib/generators/hypercube_gen.hpp"
+#include "./lib/generators/multi_probe.hpp"
+#include "./lib/lsh_cube.hpp"
+#include "./lib/clustering_phases/initialization.hpp"
+#include "./lib/clustering_phases/update.hpp"
+#include "./lib/clustering_phases/silhouette.hpp"
+#include "./lib/data_structures/user_sentiments.h"
+#include "./lib/crypto_rec.hpp"
+#include "./lib/batch_recommender.hpp"
 
 using namespace std;
 
+
+// Vectors with ids "0" to num-1, each with dim_num dimensions drawn from dist, with a generator seeded with seed
+template <typename distribution_type>
+vector< CustVector<double> > random_vectors(int num, int dim_num, unsigned long seed, distribution_type dist) {
+    default_random_engine rand_generator(seed);
+    vector< CustVector<double> > vectors;
+    for (int i = 0; i < num; i++) {
+        vector<double> dims(dim_num);
+        for (auto& dim : dims)
+            dim = dist(rand_generator);
+        vectors.emplace_back(to_string(i), dims);
+    }
+
+    return vectors;
+}
+
 unsigned int Factorial( unsigned int number ) {
     return number <= 1 ? number : Factorial(number-1)*number;
 }
@@ -29,4 +65,887 @@ TEST_CASE( "Split string into a vector of strings with input delimiter", "[strin
     REQUIRE( result[2] == "for");
     REQUIRE( result[3] == "catch2");
 
-}
\ No newline at end of file
+}
+
+// Distance kernels Test case
+TEST_CASE( "SIMD distance kernels match the scalar reference implementation", "[distance_kernels]" ) {
+    // Odd length, so that the remainder loops are also tested
+    unsigned int n = 37;
+    vector<double> a(n), b(n);
+    vector<float> a_f(n), b_f(n);
+    for (unsigned int i = 0; i < n; i++) {
+        a[i] = 0.5 * i - 3;
+        b[i] = 1.0 / (i + 1);
+        a_f[i] = float(a[i]);
+        b_f[i] = float(b[i]);
+    }
+
+    double dot = scalar_dot(a.data(), b.data(), n);
+    double squared_l2 = scalar_squared_l2(a.data(), b.data(), n);
+    double ref_dot, ref_a_norm, ref_b_norm;
+    scalar_dot_norms(a.data(), b.data(), n, &ref_dot, &ref_a_norm, &ref_b_norm);
+
+    for (const string& isa : get_supported_kernel_isas()) {
+        REQUIRE( set_kernel_isa(isa) );
+        REQUIRE( get_kernel_isa() == isa );
+
+        REQUIRE( dot_kernel(a.data(), b.data(), n) == Approx(dot) );
+        REQUIRE( squared_l2_kernel(a.data(), b.data(), n) == Approx(squared_l2) );
+        REQUIRE( dot_kernel(a_f.data(), b_f.data(), n) == Approx(dot).epsilon(1e-4) );
+        REQUIRE( squared_l2_kernel(a_f.data(), b_f.data(), n) == Approx(squared_l2).epsilon(1e-4) );
+
+        double k_dot, k_a_norm, k_b_norm;
+        dot_norms_kernel(a.data(), b.data(), n, &k_dot, &k_a_norm, &k_b_norm);
+        REQUIRE( k_dot == Approx(ref_dot) );
+        REQUIRE( k_a_norm == Approx(ref_a_norm) );
+        REQUIRE( k_b_norm == Approx(ref_b_norm) );
+
+        dot_norms_kernel(a_f.data(), b_f.data(), n, &k_dot, &k_a_norm, &k_b_norm);
+        REQUIRE( k_dot == Approx(ref_dot).epsilon(1e-4) );
+        REQUIRE( k_a_norm == Approx(ref_a_norm).epsilon(1e-4) );
+        REQUIRE( k_b_norm == Approx(ref_b_norm).epsilon(1e-4) );
+    }
+
+    // Scalar implementation is always available
+    REQUIRE( set_kernel_isa("scalar") );
+    REQUIRE_FALSE( set_kernel_isa("not_an_isa") );
+    REQUIRE( set_kernel_isa(get_supported_kernel_isas()[0]) );
+}
+
+
+TEST_CASE( "Cached norms are recalculated after every change of the dimensions", "[cust_vector]" ) {
+    auto ref_norm = [](CustVector<double>& vec) {
+        double sum = 0;
+        for (double dim : *vec.getDimensions())
+            sum = sum + dim * dim;
+        return sqrt(sum);
+    };
+    auto ref_similarity = [&](CustVector<double>& vec, CustVector<double>& other) {
+        double inner_prod = 0;
+        for (int i = 0; i < vec.getDimNumber(); i++)
+            inner_prod = inner_prod + (*vec.getDimensions())[i] * (*other.getDimensions())[i];
+        return inner_prod / (ref_norm(vec) * ref_norm(other));
+    };
+    auto require_fresh = [&](CustVector<double>& vec, CustVector<double>& other) {
+        REQUIRE(vec.getNorm() == Approx(ref_norm(vec)));
+        REQUIRE(vec.cosineSimilarity(&other) == Approx(ref_similarity(vec, other)));
+        REQUIRE(other.cosineSimilarity(&vec) == Approx(ref_similarity(vec, other)));
+    };
+
+    CustVector<double> vec("vec", {1, -2, 3, 0.5});
+    CustVector<double> other("other", {4, 3, -2, 1});
+    require_fresh(vec, other);
+
+    vec.addVectorToThis(&other);
+    require_fresh(vec, other);
+
+    vec.divDimensionsByD(3);
+    require_fresh(vec, other);
+
+    (*vec.getDimensions())[0] = 10;
+    vec.updateNorm();
+    require_fresh(vec, other);
+
+    // Hiding a score writes the mean of the other known scores into it
+    CustVector<double> user("user", {0.5, 0.2, 0.9, 0.4}, set<int>({3}), 0.4);
+    require_fresh(user, other);
+    default_random_engine rand_generator(3);
+    double old_score = 0;
+    REQUIRE(hide_one_score(user, &old_score, rand_generator));
+    require_fresh(user, other);
+}
+
+
+TEST_CASE( "Thread pool runs every task exactly once", "[thread_pool]" ) {
+    ThreadPool pool(4);
+    REQUIRE(pool.getThreadNum() == 4);
+
+    vector<int> task_runs(1000, 0);
+    for (int job_i = 0; job_i < 3; job_i++)
+        pool.parallelFor(task_runs.size(), [&](unsigned int task_i) { task_runs[task_i]++; });
+
+    for (int runs : task_runs)
+        REQUIRE(runs == 3);
+
+    // Chunks cover the whole range without overlapping
+    unsigned int begin, end, prev_end = 0;
+    for (unsigned int chunk_i = 0; chunk_i < 7; chunk_i++) {
+        get_chunk_bounds(100, 7, chunk_i, &begin, &end);
+        REQUIRE(begin == prev_end);
+        prev_end = end;
+    }
+    REQUIRE(prev_end == 100);
+}
+
+
+TEST_CASE( "User matrix rows are zero filled, aligned and padded to whole cache lines", "[user_matrix]" ) {
+    UserMatrix<double> rows(5, 11);
+    REQUIRE(rows.getRowNumber() == 5);
+    REQUIRE(rows.getDimNumber() == 11);
+    REQUIRE(rows.getRowStride() == 16);
+
+    for (unsigned int row_i = 0; row_i < rows.getRowNumber(); row_i++) {
+        REQUIRE(reinterpret_cast<uintptr_t>(rows.getRowData(row_i)) % 64 == 0);
+        for (unsigned int dim_i = 0; dim_i < rows.getDimNumber(); dim_i++)
+            REQUIRE(rows.getRowData(row_i)[dim_i] == 0);
+    }
+
+    // Writing a whole row does not touch the next one
+    for (unsigned int dim_i = 0; dim_i < rows.getDimNumber(); dim_i++)
+        rows.getRowData(2)[dim_i] = dim_i + 1;
+    REQUIRE(rows.getRowData(3)[0] == 0);
+    REQUIRE(rows.getRowData(2)[10] == 11);
+}
+
+
+TEST_CASE( "Distance cache stores symmetric pairs as a triangular matrix or a hashtable", "[distance_cache]" ) {
+    DistanceCache triangularCache(100);
+    DistanceCache hashCache(100, 0);
+    REQUIRE(triangularCache.isTriangular());
+    REQUIRE(!hashCache.isTriangular());
+
+    for (DistanceCache* cache : {&triangularCache, &hashCache}) {
+        double distance = 0;
+        REQUIRE(!cache->get(3, 7, &distance));
+
+        // Enough pairs for the hashtable to grow a few times
+        for (unsigned int i = 0; i < 100; i++)
+            for (unsigned int j = 0; j <= i; j++)
+                cache->set(i, j, i * 1000 + j);
+
+        REQUIRE(cache->get(7, 3, &distance));
+        REQUIRE(distance == 7003);
+        REQUIRE(cache->get(3, 7, &distance));
+        REQUIRE(distance == 7003);
+        REQUIRE(cache->get(99, 99, &distance));
+        REQUIRE(distance == 99099);
+
+        REQUIRE(cache->getHitNumber() == 3);
+        REQUIRE(cache->getMissNumber() == 1);
+    }
+}
+
+
+TEST_CASE( "Hashtable buckets hold every inserted vector once, in insertion order", "[cust_hashtable]" ) {
+    vector< CustVector<double> > vectors = random_vectors(200, 8, 7, uniform_real_distribution<double>(-1, 1));
+    default_random_engine rand_generator(7);
+
+    CustHashtable<double> hashtable(new CosineGGen<double>(3, 8, &rand_generator), 8);
+    vector<int> indexes;
+    for (auto& vec : vectors)
+        indexes.push_back( hashtable.insertVector(&vec) );
+    hashtable.buildBuckets();
+
+    unsigned int total = 0;
+    for (int bucket_i = 0; bucket_i < 8; bucket_i++) {
+        vector< CustVector<double>* > bucket = hashtable.getBucketFromIndex(bucket_i);
+        total = total + bucket.size();
+        for (unsigned int i = 0; i < bucket.size(); i++) {
+            REQUIRE(indexes[bucket[i] - &vectors[0]] == bucket_i);
+            if (i > 0)
+                REQUIRE(bucket[i - 1] < bucket[i]);
+        }
+    }
+    REQUIRE(total == vectors.size());
+    REQUIRE(hashtable.getBucketFor(&vectors[5]).size() == hashtable.getBucketFromIndex(indexes[5]).size());
+
+    // Views see the same vectors as the copied buckets, cosine hashes have no detailed hash to filter with
+    BucketView<double> bucketView = hashtable.viewBucketFromIndex(indexes[5]);
+    vector< CustVector<double>* > bucket = hashtable.getBucketFromIndex(indexes[5]);
+    REQUIRE(vector< CustVector<double>* >(bucketView.begin(), bucketView.end()) == bucket);
+    FilteredBucketView<double> filteredView = hashtable.viewFilteredBucketFor(&vectors[5]);
+    REQUIRE(vector< CustVector<double>* >(filteredView.begin(), filteredView.end()) == bucket);
+
+    // Vectors inserted afterwards are in the buckets once they are rebuilt
+    hashtable.insertVector(&vectors[0]);
+    hashtable.buildBuckets();
+    REQUIRE(hashtable.getBucketFromIndex(indexes[0]).back() == &vectors[0]);
+}
+
+
+TEST_CASE( "Filtered buckets keep only the vectors with the same detailed hash", "[cust_hashtable]" ) {
+    vector< CustVector<double> > vectors = random_vectors(300, 6, 11, normal_distribution<double>(0, 1));
+    default_random_engine rand_generator(11);
+    // Same dimensions as the first vector, so the same detailed hash
+    vectors.emplace_back("copy", *(vectors[0].getDimensions()));
+
+    // Few buckets, so that most vectors in a bucket have different detailed hashes
+    CustHashtable<double> hashtable(new EuclideanPhiGen<double>(3, 6, 2.0, &rand_generator), 2);
+    for (auto& vec : vectors)
+        hashtable.insertVector(&vec);
+    hashtable.buildBuckets();
+
+    vector< CustVector<double>* > bucket = hashtable.getBucketFor(&vectors[0]);
+    vector< CustVector<double>* > filtered = hashtable.getFilteredBucketFor(&vectors[0]);
+    REQUIRE(filtered.size() < bucket.size());
+    REQUIRE(find(filtered.begin(), filtered.end(), &vectors[0]) != filtered.end());
+    REQUIRE(find(filtered.begin(), filtered.end(), &vectors.back()) != filtered.end());
+    for (auto filteredVector : filtered)
+        REQUIRE(find(bucket.begin(), bucket.end(), filteredVector) != bucket.end());
+}
+
+
+TEST_CASE( "Query hashing is deterministic and can run on many threads at once", "[hash_generator]" ) {
+    vector< CustVector<double> > vectors = random_vectors(500, 10, 5, normal_distribution<double>(0, 1));
+    default_random_engine rand_generator(5);
+
+    vector< HashGenerator<double>* > fFunctions;
+    for (int i = 0; i < 8; i++)
+        fFunctions.emplace_back( new EuclideanFGen<double>(10, 1.0, &rand_generator) );
+    CustHashtable<double> hypercube(new HypercubeGen<double>(fFunctions), 256);
+    for (auto& vec : vectors)
+        hypercube.insertVector(&vec);
+    hypercube.buildBuckets();
+
+    vector<int> serial_hashes;
+    for (auto& vec : vectors)
+        serial_hashes.push_back( hypercube.getHash(&vec) );
+
+    ThreadPool pool(4);
+    vector<int> parallel_hashes(vectors.size());
+    vector<unsigned int> bucket_sizes(vectors.size());
+    pool.parallelFor(vectors.size(), [&](unsigned int vec_i) {
+        parallel_hashes[vec_i] = hypercube.getHash(&vectors[vec_i]);
+        bucket_sizes[vec_i] = hypercube.viewBucketFor(&vectors[vec_i]).size();
+    });
+
+    REQUIRE(parallel_hashes == serial_hashes);
+    for (unsigned int vec_i = 0; vec_i < vectors.size(); vec_i++)
+        REQUIRE(bucket_sizes[vec_i] == hypercube.viewBucketFromIndex(serial_hashes[vec_i]).size());
+}
+
+
+TEST_CASE( "Hashtables built from batched projections agree with hashing every vector on its own", "[lsh_cube]" ) {
+    // Not a multiple of the hashing block, so that the last block is only partly full
+    vector< CustVector<double> > vectors = random_vectors(3 * HASH_BLOCK_ROWS + 5, 12, 13,
+            normal_distribution<double>(0, 1));
+
+    ThreadPool pool(3);
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustHashtable<double>* > hashtables = create_LSH_hashtables(vectors, metric, 4, 3, 8, 4.0, 13, pool);
+        for (auto hashtable : hashtables) {
+            for (auto& vec : vectors) {
+                BucketView<double> bucketView = hashtable->viewBucketFromIndex( hashtable->getHash(&vec) );
+                REQUIRE(find(bucketView.begin(), bucketView.end(), &vec) != bucketView.end());
+            }
+
+            // Every vector is in the filtered bucket of itself, so the detailed hashes match too
+            for (auto& vec : vectors) {
+                vector< CustVector<double>* > filtered = hashtable->getFilteredBucketFor(&vec);
+                REQUIRE(find(filtered.begin(), filtered.end(), &vec) != filtered.end());
+            }
+            delete hashtable;
+        }
+    }
+}
+
+
+TEST_CASE( "Hashtables built in parallel are the same as hashtables built serially from the same seed", "[lsh_cube]" ) {
+    vector< CustVector<double> > vectors = random_vectors(1000, 8, 17, normal_distribution<double>(0, 1));
+
+    // Fewer hashtables than threads, so the buckets of each hashtable are counted and scattered in parallel
+    ThreadPool serial_pool(1);
+    ThreadPool parallel_pool(4);
+    for (int L : {2, 6}) {
+        vector< CustHashtable<double>* > serial = create_empty_LSH_hashtables<double>("euclidean", 3, L, 8,
+                vectors.size(), 50, 2.0, 42, serial_pool);
+        insert_hashed_blocks(serial, vectors, serial_pool);
+        build_all_buckets(serial, serial_pool);
+
+        vector< CustHashtable<double>* > parallel = create_empty_LSH_hashtables<double>("euclidean", 3, L, 8,
+                vectors.size(), 50, 2.0, 42, parallel_pool);
+        insert_hashed_blocks(parallel, vectors, parallel_pool);
+        build_all_buckets(parallel, parallel_pool);
+
+        for (int table_i = 0; table_i < L; table_i++) {
+            REQUIRE(serial[table_i]->getBucketNumber() == parallel[table_i]->getBucketNumber());
+            for (unsigned int bucket_i = 0; bucket_i < serial[table_i]->getBucketNumber(); bucket_i++)
+                REQUIRE(serial[table_i]->getBucketFromIndex(bucket_i) == parallel[table_i]->getBucketFromIndex(bucket_i));
+            for (auto& vec : vectors)
+                REQUIRE(serial[table_i]->getFilteredBucketFor(&vec) == parallel[table_i]->getFilteredBucketFor(&vec));
+
+            delete serial[table_i];
+            delete parallel[table_i];
+        }
+    }
+}
+
+
+TEST_CASE( "The same seed gives the same random choices, and derived streams differ", "[seed]" ) {
+    REQUIRE(derive_seed(1, 0) == derive_seed(1, 0));
+    REQUIRE(derive_seed(1, 0) != derive_seed(1, 1));
+    REQUIRE(derive_seed(1, 0) != derive_seed(2, 0));
+
+    vector< CustVector<double> > vectors = random_vectors(300, 5, 19, normal_distribution<double>(0, 1));
+
+    REQUIRE(k_means_pp(vectors, 10, "euclidean", 7) == k_means_pp(vectors, 10, "euclidean", 7));
+    REQUIRE(rand_selection(vectors, 10, 7) == rand_selection(vectors, 10, 7));
+
+    ThreadPool pool(3);
+    vector< CustHashtable<double>* > first = create_LSH_hashtables(vectors, "euclidean", 3, 2, 10, 2.0, 7, pool);
+    vector< CustHashtable<double>* > second = create_LSH_hashtables(vectors, "euclidean", 3, 2, 10, 2.0, 7, pool);
+    // Seeds that only differ in their upper 32 bits give different hashtables too
+    vector< CustHashtable<double>* > upper = create_LSH_hashtables(vectors, "euclidean", 3, 2, 10, 2.0,
+            7 + (1UL << 32), pool);
+    bool upper_differs = false;
+    for (int table_i = 0; table_i < 2; table_i++) {
+        for (auto& vec : vectors) {
+            REQUIRE(first[table_i]->getHash(&vec) == second[table_i]->getHash(&vec));
+            if (first[table_i]->getHash(&vec) != upper[table_i]->getHash(&vec))
+                upper_differs = true;
+        }
+        delete first[table_i];
+        delete second[table_i];
+        delete upper[table_i];
+    }
+    REQUIRE(upper_differs);
+}
+
+
+TEST_CASE( "Initialization picks the same centroids however the distances are updated", "[initialization]" ) {
+    vector< CustVector<double> > vectors = random_vectors(400, 6, 53, normal_distribution<double>(0, 1));
+
+    for (string metric : {"euclidean", "cosine"}) {
+        // k-means++ that recalculates the distance of every vector from all the centroids chosen so far
+        default_random_engine rand_generator(59);
+        uniform_int_distribution<int> uni_int_dist(0, vectors.size()-1);
+        vector< CustVector<double>* > expected(1, &vectors[uni_int_dist(rand_generator)]);
+        while (expected.size() < 12) {
+            vector<double> weights(vectors.size());
+            for (int vector_i = 0; vector_i < vectors.size(); vector_i++) {
+                double min_dist = -1;
+                for (auto centroid : expected) {
+                    double distance = vector_distance(vectors[vector_i], centroid, metric);
+                    if (min_dist == -1 || distance < min_dist)
+                        min_dist = distance;
+                }
+                weights[vector_i] = min_dist * min_dist;
+            }
+            expected.emplace_back(&vectors[weighted_random_index(weights, rand_generator)]);
+        }
+        REQUIRE(k_means_pp(vectors, 12, metric, 59) == expected);
+
+        // The candidates of k-means|| are sampled in fixed chunks, so they do not depend on the number of threads
+        ThreadPool serial_pool(1);
+        ThreadPool parallel_pool(4);
+        REQUIRE(k_means_parallel(vectors, 12, metric, 3, 24, 61, serial_pool) ==
+                k_means_parallel(vectors, 12, metric, 3, 24, 61, parallel_pool));
+    }
+}
+
+
+TEST_CASE( "Mini-batch k-means does not depend on the number of threads, and stops early", "[update]" ) {
+    vector< CustVector<double> > vectors = random_vectors(600, 5, 67, normal_distribution<double>(0, 1));
+
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustVector<double> > serial_vectors = vectors, parallel_vectors = vectors;
+        vector< CustVector<double>* > serial_init = k_means_pp(serial_vectors, 6, metric, 71);
+        vector< CustVector<double>* > parallel_init = k_means_pp(parallel_vectors, 6, metric, 71);
+        KMeansCenters<double> serial_centers(serial_init, 8);
+        KMeansCenters<double> parallel_centers(parallel_init, 8);
+
+        ThreadPool serial_pool(1);
+        ThreadPool parallel_pool(4);
+        int serial_batches = mini_batch_k_means(serial_vectors, serial_centers, metric, 50, 40, 1000, 0, 73, serial_pool);
+        int parallel_batches = mini_batch_k_means(parallel_vectors, parallel_centers, metric, 50, 40, 1000, 0, 73,
+                parallel_pool);
+        REQUIRE(serial_batches == 40);
+        REQUIRE(parallel_batches == serial_batches);
+        for (int cluster_i = 0; cluster_i < 6; cluster_i++)
+            REQUIRE(*serial_centers.getCenter(cluster_i)->getDimensions() ==
+                    *parallel_centers.getCenter(cluster_i)->getDimensions());
+        for (int vector_i = 0; vector_i < vectors.size(); vector_i++)
+            REQUIRE(serial_vectors[vector_i].getCluster() == parallel_vectors[vector_i].getCluster());
+
+        // A center always moves less than a huge min_dist, so the first batch is the last
+        vector< CustVector<double>* > moved_init = k_means_pp(vectors, 6, metric, 71);
+        KMeansCenters<double> moved_centers(moved_init, 8);
+        REQUIRE(mini_batch_k_means(vectors, moved_centers, metric, 50, 40, 1000, 1e9, 73, parallel_pool) == 1);
+
+        // Without patience, the first batch that does not improve the smoothed inertia is the last
+        vector< CustVector<double>* > patience_init = k_means_pp(vectors, 6, metric, 71);
+        KMeansCenters<double> patience_centers(patience_init, 8);
+        REQUIRE(mini_batch_k_means(vectors, patience_centers, metric, 50, 1000, 1, 0, 73, parallel_pool) < 1000);
+    }
+}
+
+
+TEST_CASE( "Fused Lloyd's k-means is the same as Lloyd's assignment followed by the k-means update", "[update]" ) {
+    vector< CustVector<double> > vectors = random_vectors(500, 4, 89, normal_distribution<double>(0, 1));
+    ThreadPool pool(4);
+
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustVector<double> > fused_vectors = vectors, separate_vectors = vectors;
+        vector< CustVector<double>* > initial_centroids = k_means_pp(fused_vectors, 7, metric, 97);
+        KMeansCenters<double> fused_centers(initial_centroids, 8);
+        vector< CustVector<double>* > separate_centers = k_means_pp(separate_vectors, 7, metric, 97);
+
+        // Chunk sums are merged in a different order than k_means adds the vectors, so centers can differ in the
+        // last bits
+        for (int iteration = 0; iteration < 5; iteration++) {
+            bool fused_continue = lloyds_k_means(fused_vectors, fused_centers, metric, 0, pool);
+            lloyds_assignment(separate_vectors, separate_centers, metric);
+            for (int vector_i = 0; vector_i < vectors.size(); vector_i++) {
+                REQUIRE(fused_vectors[vector_i].getCluster() == separate_vectors[vector_i].getCluster());
+                REQUIRE(fused_vectors[vector_i].getDistFromCentroid() ==
+                        Approx(separate_vectors[vector_i].getDistFromCentroid()).margin(1e-12));
+            }
+
+            bool separate_continue = k_means(separate_vectors, separate_centers, metric, 0);
+            REQUIRE(fused_continue == separate_continue);
+            for (int cluster_i = 0; cluster_i < 7; cluster_i++)
+                for (int dim_i = 0; dim_i < 4; dim_i++)
+                    REQUIRE((*fused_centers.getCenter(cluster_i)->getDimensions())[dim_i] ==
+                            Approx((*separate_centers[cluster_i]->getDimensions())[dim_i]).margin(1e-12));
+        }
+
+        for (auto center : separate_centers)
+            if (center->getId() == "k_means_center")
+                delete center;
+    }
+}
+
+
+TEST_CASE( "Hamerly's k-means skips distances but assigns the same clusters as Lloyd's", "[update]" ) {
+    vector< CustVector<double> > vectors = random_vectors(2000, 2, 101, normal_distribution<double>(0, 1));
+    ThreadPool pool(4);
+
+    vector< CustVector<double> > hamerly_vectors = vectors, lloyds_vectors = vectors;
+    vector< CustVector<double>* > initial_centroids = k_means_pp(vectors, 5, "euclidean", 103);
+    KMeansCenters<double> hamerly_centers(initial_centroids, 8);
+    KMeansCenters<double> lloyds_centers(initial_centroids, 8);
+    KMeansBounds bounds(vectors.size(), 5, 8);
+
+    for (int iteration = 0; iteration < 10; iteration++) {
+        bool hamerly_continue = hamerly_k_means(hamerly_vectors, hamerly_centers, bounds, 0, pool);
+        bool lloyds_continue = lloyds_k_means(lloyds_vectors, lloyds_centers, "euclidean", 0, pool);
+        REQUIRE(hamerly_continue == lloyds_continue);
+
+        for (int vector_i = 0; vector_i < vectors.size(); vector_i++) {
+            REQUIRE(hamerly_vectors[vector_i].getCluster() == lloyds_vectors[vector_i].getCluster());
+            // Vectors that the bounds skipped keep an upper bound of their distance
+            REQUIRE(hamerly_vectors[vector_i].getDistFromCentroid() >=
+                    lloyds_vectors[vector_i].getDistFromCentroid() - 1e-9);
+        }
+        for (int cluster_i = 0; cluster_i < 5; cluster_i++)
+            REQUIRE(*hamerly_centers.getCenter(cluster_i)->getDimensions() ==
+                    *lloyds_centers.getCenter(cluster_i)->getDimensions());
+    }
+
+    REQUIRE(bounds.getPrunedNumber() > 0);
+}
+
+
+TEST_CASE( "Range assignments leave the vectors that no range search reaches to parallel Lloyd's", "[assignment]" ) {
+    vector< CustVector<double> > vectors = random_vectors(500, 6, 79, normal_distribution<double>(0, 1));
+    ThreadPool pool(4);
+
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustVector<double>* > centroids = k_means_pp(vectors, 8, metric, 83);
+        vector< CustHashtable<double>* > hashtables = create_LSH_hashtables(vectors, metric, 6, 2, 8, 2.0, 83, pool);
+        CustHashtable<double>* hypercube = create_hypercube(vectors, metric, 6, 2.0, 83, pool);
+
+        for (bool cube : {false, true}) {
+            if (cube)
+                cube_range_assignment(vectors, *hypercube, centroids, metric, 2, 6, pool);
+            else
+                lsh_range_assignment(vectors, hashtables, centroids, metric, pool);
+            vector<int> clusters;
+            vector<double> distances;
+            for (auto& vec : vectors) {
+                clusters.emplace_back(vec.getCluster());
+                distances.emplace_back(vec.getDistFromCentroid());
+            }
+
+            // Same assignment, with the remaining vectors assigned serially
+            remove_clustering(vectors);
+            vector< vector< CustVector<double>* > > comb_buckets(centroids.size());
+            for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
+                comb_buckets[centroid_i] = cube ?
+                        get_hypercube_combined_buckets(*hypercube, centroids[centroid_i], 2, 6) :
+                        get_LSH_combined_buckets(hashtables, centroids[centroid_i]);
+            range_assignment(vectors, comb_buckets, centroids, metric);
+
+            int remaining_num = 0;
+            for (auto& vec : vectors)
+                if (vec.getCluster() == -1)
+                    remaining_num++;
+            REQUIRE(remaining_num > 0);
+
+            lloyds_for_remaining(vectors, centroids, metric);
+            for (int centroid_i = 0; centroid_i < centroids.size(); centroid_i++)
+                centroids[centroid_i]->setCluster(centroid_i, 0);
+            for (int vector_i = 0; vector_i < vectors.size(); vector_i++) {
+                REQUIRE(vectors[vector_i].getCluster() == clusters[vector_i]);
+                REQUIRE(vectors[vector_i].getDistFromCentroid() == distances[vector_i]);
+            }
+        }
+
+        for (auto hashtable : hashtables)
+            delete hashtable;
+        delete hypercube;
+    }
+}
+
+
+TEST_CASE( "Parallel and sampled silhouettes agree with the silhouette of the clusters", "[silhouette]" ) {
+    // Not a multiple of the tile rows, so that clusters end in partly full tiles
+    vector< CustVector<double> > vectors = random_vectors(1000, 5, 107, normal_distribution<double>(0, 1));
+
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustVector<double>* > centroids = k_means_pp(vectors, 6, metric, 109);
+        lloyds_assignment(vectors, centroids, metric);
+        vector< vector< CustVector<double>* > > clusters = separate_clusters_from_input(vectors, centroids.size());
+        vector<double> expected = silhouette_cluster(clusters, centroids, metric);
+
+        ThreadPool serial_pool(1);
+        ThreadPool parallel_pool(4);
+        vector<double> serial = parallel_silhouette(vectors, centroids, metric, serial_pool);
+        vector<double> parallel = parallel_silhouette(vectors, centroids, metric, parallel_pool);
+        REQUIRE(serial == parallel);
+        REQUIRE(parallel.size() == expected.size());
+        for (int i = 0; i < expected.size(); i++)
+            REQUIRE(parallel[i] == Approx(expected[i]).margin(1e-12));
+
+        // The 95% confidence interval of the estimate should hold the overall silhouette for almost every seed
+        int covered_num = 0;
+        for (unsigned long seed = 0; seed < 20; seed++) {
+            double confidence_interval = 0;
+            double sampled = sampled_silhouette(vectors, centroids, metric, 400, seed, parallel_pool,
+                    &confidence_interval);
+            REQUIRE(confidence_interval > 0);
+            if (fabs(sampled - expected.back()) <= confidence_interval)
+                covered_num++;
+        }
+        REQUIRE(covered_num >= 16);
+    }
+}
+
+
+TEST_CASE( "Multi-probe lookups add the buckets closest to the query to its own", "[multi_probe]" ) {
+    // Perturbation sets come in increasing order of the sum of their squared scores, and reusing the buffer for
+    // another query gives the same sets as a new one
+    PerturbationBuffer perturbations;
+    auto get_sets = [&perturbations]() {
+        vector< vector<unsigned int> > sets;
+        for (unsigned int set_i = 0; set_i < perturbations.getSetNumber(); set_i++) {
+            sets.emplace_back();
+            for (const unsigned int* it = perturbations.setBegin(set_i); it != perturbations.setEnd(set_i); ++it)
+                sets.back().emplace_back(perturbations.getPerturbationId(*it));
+        }
+        return sets;
+    };
+    for (int repeat = 0; repeat < 2; repeat++) {
+        perturbations.clear();
+        perturbations.addPerturbation(0.3, 12);
+        perturbations.addPerturbation(0.1, 10);
+        perturbations.addPerturbation(0.2, 11);
+        perturbations.generateSets(4, [](const vector<unsigned int>&) { return true; });
+        REQUIRE(get_sets() == vector< vector<unsigned int> >({ {10}, {11}, {10, 11}, {12} }));
+        perturbations.generateSets(4, [](const vector<unsigned int>& set) { return set.size() == 1; });
+        REQUIRE(get_sets() == vector< vector<unsigned int> >({ {10}, {11}, {12} }));
+    }
+
+    vector< CustVector<double> > vectors = random_vectors(400, 6, 23, normal_distribution<double>(0, 1));
+
+    ThreadPool pool(2);
+    for (string metric : {"euclidean", "cosine"}) {
+        vector< CustHashtable<double>* > hashtables = create_LSH_hashtables(vectors, metric, 4, 2, 4, 1.0, 29, pool);
+
+        unsigned int single_total = 0, probed_total = 0;
+        CandidateSet candidates(vectors.size());
+        ProbeBuffer<double> probes;
+        vector< CustVector<double>* > single, fewer_probes, more_probes;
+        for (auto& vec : vectors) {
+            single = get_LSH_filtered_combined_buckets(hashtables, &vec);
+            get_LSH_filtered_combined_buckets(hashtables, &vec, 1, candidates, probes, fewer_probes);
+            REQUIRE(fewer_probes == single);
+
+            // Every probe sequence starts with the shorter ones, so more probes only add candidates
+            get_LSH_filtered_combined_buckets(hashtables, &vec, 3, candidates, probes, fewer_probes);
+            get_LSH_filtered_combined_buckets(hashtables, &vec, 8, candidates, probes, more_probes);
+            sort(single.begin(), single.end());
+            sort(fewer_probes.begin(), fewer_probes.end());
+            sort(more_probes.begin(), more_probes.end());
+            REQUIRE(includes(fewer_probes.begin(), fewer_probes.end(), single.begin(), single.end()));
+            REQUIRE(includes(more_probes.begin(), more_probes.end(), fewer_probes.begin(), fewer_probes.end()));
+
+            single_total = single_total + single.size();
+            probed_total = probed_total + more_probes.size();
+        }
+        REQUIRE(probed_total > single_total);
+
+        for (auto hashtable : hashtables)
+            delete hashtable;
+    }
+}
+
+
+TEST_CASE( "Candidate sets keep each index once per query", "[candidate_set]" ) {
+    CandidateSet candidates(10);
+    REQUIRE(candidates.insert(3));
+    REQUIRE(candidates.insert(7));
+    REQUIRE(!candidates.insert(3));
+    REQUIRE(candidates.insert(0));
+    REQUIRE(candidates.getCandidates() == vector<uint32_t>({3, 7, 0}));
+
+    // A new query forgets the previous candidates
+    candidates.clear();
+    REQUIRE(candidates.getCandidateNumber() == 0);
+    REQUIRE(candidates.insert(7));
+    REQUIRE(candidates.getCandidates() == vector<uint32_t>({7}));
+
+    // A capped set is capped as soon as it is full, refuses new candidates, and counts the queries that reached the cap
+    CandidateSet capped(10, 2);
+    capped.clear();
+    REQUIRE(capped.insert(1));
+    REQUIRE(!capped.isCapped());
+    REQUIRE(capped.insert(2));
+    REQUIRE(capped.isCapped());
+    REQUIRE(!capped.insert(2));
+    REQUIRE(!capped.insert(5));
+    REQUIRE(capped.getCandidateNumber() == 2);
+    capped.clear();
+    REQUIRE(!capped.isCapped());
+    REQUIRE(capped.insert(5));
+    REQUIRE(capped.getQueryNumber() == 2);
+    REQUIRE(capped.getCappedNumber() == 1);
+
+    // The candidates of the lsh buckets are the same vectors that a set of them would hold
+    vector< CustVector<double> > vectors = random_vectors(300, 5, 31, normal_distribution<double>(0, 1));
+
+    ThreadPool pool(2);
+    vector< CustHashtable<double>* > hashtables = create_LSH_hashtables(vectors, "cosine", 3, 4, 4, 1.0, 37, pool);
+    CandidateSet lsh_candidates(vectors.size());
+    ProbeBuffer<double> probes;
+    for (auto& vec : vectors) {
+        set< CustVector<double>* > expected;
+        for (auto hashtable : hashtables) {
+            FilteredBucketView<double> bucket = hashtable->viewFilteredBucketFor(&vec);
+            expected.insert(bucket.begin(), bucket.end());
+        }
+
+        vector< CustVector<double>* > output;
+        get_LSH_filtered_combined_buckets(hashtables, &vec, 1, lsh_candidates, probes, output);
+        REQUIRE(lsh_candidates.getCandidateNumber() == expected.size());
+        REQUIRE(set< CustVector<double>* >(output.begin(), output.end()) == expected);
+        for (uint32_t index : lsh_candidates.getCandidates())
+            REQUIRE(expected.count(&vectors[index]) == 1);
+    }
+
+
+    // With a cap, the candidates are the first ones of the uncapped collection, always the same for a query
+    CandidateSet uncapped(vectors.size()), capped_lsh(vectors.size(), 230);
+    for (auto& vec : vectors) {
+        collect_LSH_filtered_candidates(hashtables, &vec, 3, uncapped, probes);
+        unsigned int candidate_num = collect_LSH_filtered_candidates(hashtables, &vec, 3, capped_lsh, probes);
+        REQUIRE(candidate_num == min(230u, uncapped.getCandidateNumber()));
+        REQUIRE(equal(capped_lsh.getCandidates().begin(), capped_lsh.getCandidates().end(),
+                      uncapped.getCandidates().begin()));
+    }
+    REQUIRE(capped_lsh.getCappedNumber() > 0);
+    REQUIRE(capped_lsh.getCappedNumber() < capped_lsh.getQueryNumber());
+
+    for (auto hashtable : hashtables)
+        delete hashtable;
+}
+
+
+TEST_CASE( "Top selection keeps the highest scores with their items, like a stable sort", "[crypto_rec]" ) {
+    // Few different scores, so there are many ties, like the similarities of sentiment vectors
+    default_random_engine rand_generator(41);
+    uniform_int_distribution<int> uni_int_dist(0, 6);
+    for (int top_num : {0, 1, 5, 20, 500}) {
+        vector<double> scores;
+        vector<int> items;
+        for (int i = 0; i < 300; i++) {
+            scores.emplace_back(uni_int_dist(rand_generator) / 6.0);
+            items.emplace_back(i);
+        }
+
+        vector<int> expected = items;
+        stable_sort(expected.begin(), expected.end(), [&scores](int a, int b) { return scores[a] > scores[b]; });
+        expected.resize(min<size_t>(top_num, expected.size()));
+
+        vector<double> all_scores = scores;
+        select_top(scores, items, top_num);
+        REQUIRE(items == expected);
+        for (int i = 0; i < items.size(); i++)
+            REQUIRE(scores[i] == all_scores[items[i]]);
+    }
+
+    // NaN scores, eg. the similarity with a zero vector, come last
+    vector<double> scores = {NAN, 0.5, -1, 0.9};
+    vector<string> items = {"nan", "half", "minus", "most"};
+    select_top(scores, items, 4);
+    REQUIRE(items == vector<string>({"most", "half", "minus", "nan"}));
+}
+
+
+TEST_CASE( "Streamed tweets are added to the sentiments of their users", "[tweets]" ) {
+    string filename = "tweets_stream_test.tsv";
+    {
+        ofstream out(filename);
+        out << "P\t3\r\n";
+        out << "alice\t1\tgood\tbtc\r\n";
+        out << "bob\t2\tbad\teth\tbitcoin\n";
+        out << "\r\n";
+        out << "alice\t3\tgood\tgood\teth\r\n";
+        out << "carol\t4\tnothing\there";
+    }
+    unordered_map<string, float> lexicon = {{"good", 2}, {"bad", -3}};
+    vector< vector<string> > query_crypto = {{"btc", "bitcoin"}, {"eth"}, {"xrp"}};
+
+    // Chunks of a few bytes split lines, and \r\n pairs, between chunks
+    for (unsigned int chunk_size : {1u, 2u, 3u, 7u, TWEET_CHUNK_SIZE}) {
+        int P = 1;
+        UserSentiments sentiments(query_crypto.size());
+        int tweet_num = read_tweets(filename, '\t', &P, lexicon, query_crypto, [&](Tweet& tweet) {
+            sentiments.addTweet(sentiments.addUser(tweet.getUserId()), tweet);
+        }, chunk_size);
+
+        REQUIRE(tweet_num == 4);
+        REQUIRE(P == 3);
+        REQUIRE(sentiments.getUserNumber() == 3);
+        REQUIRE(sentiments.getUserId(0) == "alice");
+        REQUIRE(sentiments.getUserId(2) == "carol");
+
+        // Only positive sentiments are added, but every mentioned cryptocurrency is known
+        REQUIRE(sentiments.getScore(0, 0) == Approx(2 / sqrt(19.0)));
+        REQUIRE(sentiments.getScore(0, 1) == Approx(4 / sqrt(31.0)));
+        REQUIRE(sentiments.getScore(1, 0) == 0);
+        REQUIRE(sentiments.isMentioned(1, 0));
+        REQUIRE(sentiments.isMentioned(1, 1));
+        REQUIRE(!sentiments.isMentioned(0, 2));
+
+        // Users without any positive sentiment are filtered, unknown scores get the known mean
+        vector< CustVector<double> > users = sentiments_to_user_vectors<double>(sentiments);
+        REQUIRE(users.size() == 1);
+        REQUIRE(users[0].getId() == "alice");
+        REQUIRE(users[0].getUnknownIndexes() == vector<int>({2}));
+        REQUIRE((*users[0].getDimensions())[2] == Approx((2 / sqrt(19.0) + 4 / sqrt(31.0)) / 2));
+    }
+    remove(filename.c_str());
+
+    int P = 1;
+    REQUIRE(read_tweets("no_such_file.tsv", '\t', &P, lexicon, query_crypto, [](Tweet&) {}) == -1);
+}
+
+
+TEST_CASE( "Predictions from the centered scores follow the similarity weighted formula", "[crypto_rec]" ) {
+    default_random_engine rand_generator(47);
+    uniform_real_distribution<double> score_dist(0, 4);
+    uniform_real_distribution<double> sim_dist(-1, 1);
+    vector< CustVector<double> > users;
+    for (auto& vec : random_vectors(20, 10, 47, score_dist)) {
+        int i = users.size();
+        users.emplace_back(vec.getId(), *vec.getDimensions(), set<int>({i % 10, (i + 3) % 10}),
+                score_dist(rand_generator));
+    }
+
+    vector< CustVector<double>* > neighbors;
+    for (int i = 1; i < users.size(); i++)
+        neighbors.emplace_back(&users[i]);
+    vector<double> centered_scores = get_centered_scores(neighbors);
+
+    // A subset of the neighbors, out of order
+    vector<int> rows = {7, 2, 11, 0, 18};
+    vector<double> similarities;
+    for (int i = 0; i < rows.size(); i++)
+        similarities.emplace_back(sim_dist(rand_generator));
+
+    CustVector<double>& user = users[0];
+    vector<double> predicted = get_predicted_user_sim(centered_scores, rows, user, similarities);
+    for (int index = 0; index < 10; index++) {
+        if (user.getUnknownIndexesSet().count(index) == 0) {
+            REQUIRE(predicted[index] == (*user.getDimensions())[index]);
+            continue;
+        }
+
+        double main_sum = 0;
+        double abs_sum = 0;
+        for (int i = 0; i < rows.size(); i++) {
+            CustVector<double>* neighbor = neighbors[rows[i]];
+            main_sum = main_sum + similarities[i] * ((*neighbor->getDimensions())[index] - neighbor->getKnownMean());
+            abs_sum = abs_sum + fabs(similarities[i]);
+        }
+        REQUIRE(predicted[index] == Approx(main_sum / abs_sum + user.getKnownMean()));
+    }
+}
+
+
+TEST_CASE( "Batch recommendations are the same as recommending one user at a time", "[batch_recommender]" ) {
+    // Users with a few unknown cryptocurrencies each, that have the mean of the known ones
+    default_random_engine rand_generator(43);
+    uniform_int_distribution<int> coin_dist(0, 11);
+    vector< CustVector<double> > users;
+    for (auto& vec : random_vectors(450, 12, 43, uniform_real_distribution<double>(0, 4))) {
+        set<int> unknown = {coin_dist(rand_generator), coin_dist(rand_generator), coin_dist(rand_generator)};
+        users.emplace_back(vec.getId(), *vec.getDimensions(), unknown, 2.0);
+    }
+
+    vector< CustVector<double>* > first_half, second_half;
+    for (int i = 0; i < users.size(); i++)
+        (i < 225 ? first_half : second_half).emplace_back(&users[i]);
+
+    // Users with the same candidates share a group, whichever way they are added
+    BatchRecommender<double> recommender(users.size());
+    int first_group = recommender.addGroup(first_half);
+    for (int i = 0; i < users.size(); i++) {
+        if (i % 3 == 0)
+            recommender.addUserToGroup(i, first_group);
+        else if (i % 3 == 1)
+            recommender.addUser(i, second_half);
+        else if (i % 5 != 0)
+            recommender.addUser(i, first_half);
+    }
+    REQUIRE(recommender.getGroupNumber() == 3);
+
+    // Groups of more than one block of users are shared by the threads, the result is the same for any number of them
+    for (int thread_num : {1, 4}) {
+        ThreadPool pool(thread_num);
+        for (int P : {0, 10}) {
+            vector< vector<int> > recommendations;
+            recommender.recommend(users, P, 3, &recommendations, pool);
+
+            for (int i = 0; i < users.size(); i++) {
+                if (i % 3 == 2 && i % 5 == 0) {
+                    REQUIRE(!recommender.hasCandidates(i));
+                    continue;
+                }
+
+                vector< CustVector<double>* > neighbors = (i % 3 == 1) ? second_half : first_half;
+                vector<int> expected;
+                if (P > 0) {
+                    vector<double> similarities = get_P_closest(neighbors, users[i], P);
+                    expected = get_top_N_recom(neighbors, users[i], 3, similarities);
+                }
+                else
+                    expected = get_top_N_recom(neighbors, users[i], 3);
+
+                REQUIRE(recommender.hasCandidates(i));
+                REQUIRE(recommendations[i] == expected);
+            }
+        }
+    }
+
+    // Recommending in batches, clearing the groups after each one, gives the same recommendations
+    ThreadPool pool(2);
+    vector< vector<int> > all_recommendations, batch_recommendations;
+    recommender.recommend(users, 10, 3, &all_recommendations, pool);
+    REQUIRE(recommender.getCandidateNumber() == first_half.size() * 2 + second_half.size());
+    recommender.clear();
+    REQUIRE(recommender.getGroupNumber() == 0);
+    REQUIRE(recommender.getCandidateNumber() == 0);
+    for (int i = 0; i < users.size(); i++) {
+        REQUIRE(!recommender.hasCandidates(i));
+        recommender.addUser(i, (i % 3 == 1) ? second_half : first_half);
+        if (i % 100 == 99 || i + 1 == users.size()) {
+            recommender.recommend(users, 10, 3, &batch_recommendations, pool);
+            for (int batch_i = i - i % 100; batch_i <= i; batch_i++)
+                if (batch_i % 3 != 2 || batch_i % 5 != 0)
+                    REQUIRE(batch_recommendations[batch_i] == all_recommendations[batch_i]);
+            recommender.clear();
+        }
+    }
+}